@@ -0,0 +1,739 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "fb.h"
+#include "config.h"
+#include "snapshot.h"
+#include "histstore.h"
+#include "sock.h"
+#include "ingest.h"
+#include "json.h"
+#include "stats.h"
+
+#ifndef RTOP_VERSION
+#define RTOP_VERSION "unknown"
+#endif
+
+#define BENCH_W 1920
+#define BENCH_H 1080
+// untimed runs of each benchmark, then timed repetitions of BENCH_OPS
+// operations each unless a benchmark says otherwise
+#define BENCH_WARMUP 2
+#define BENCH_REPETITIONS 10
+#define BENCH_OPS 20
+#define BENCH_MICRO_OPS 10000
+#define BENCH_WIDGETS 500
+#define BENCH_FONT "consolas.ttf"
+#define BENCH_PNGS 8
+#define BENCH_PNG_W 1280
+#define BENCH_PNG_H 720
+#define BENCH_HISTORY_IDS 4000
+#define BENCH_HISTORY_SAMPLES 256
+// identifiers in a packet nothing routes to
+#define BENCH_UNKNOWN_IDS 100
+
+volatile bool running = true;
+
+// one benchmark, driven by bench_start() and bench_next() around its loop:
+//
+//     for (bench_start(&b, ops, bytes, "name"); bench_next(&b);) {
+//         for (size_t i = 0; i < b.ops; i++) { ... }
+//     }
+typedef struct _Bench {
+    char name[64];
+    size_t ops;
+    size_t bytes;
+    int rep;
+    bool skip;
+    double start;
+    double samples[BENCH_REPETITIONS];
+} Bench;
+
+// rtop-bench [--json] [filter], filter selecting benchmarks by substring
+static const char *bench_filter = NULL;
+static bool bench_json = false;
+// where results go; with --json a copy of stdout, stdout itself then going
+// to stderr so nothing printed by the code under test lands between lines
+static FILE *bench_out;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_start(Bench *b, size_t ops, size_t bytes, const char *format, ...) {
+    va_list args;
+
+    memset(b, 0, sizeof(Bench));
+    va_start(args, format);
+    vsnprintf(b->name, sizeof(b->name), format, args);
+    va_end(args);
+
+    b->ops = ops;
+    b->bytes = bytes;
+    b->rep = -BENCH_WARMUP - 1;
+    b->skip = bench_filter && !strstr(b->name, bench_filter);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// ns per operation over the repetitions; the median is the headline number
+static void bench_report(Bench *b) {
+    double ns[BENCH_REPETITIONS], mean = 0, variance = 0;
+
+    for (int i = 0; i < BENCH_REPETITIONS; i++) {
+        ns[i] = b->samples[i] / b->ops * 1e9;
+        mean += ns[i] / BENCH_REPETITIONS;
+    }
+    for (int i = 0; i < BENCH_REPETITIONS; i++) {
+        variance += (ns[i] - mean) * (ns[i] - mean) / (BENCH_REPETITIONS - 1);
+    }
+    qsort(ns, BENCH_REPETITIONS, sizeof(double), compare_double);
+
+    double median = (ns[(BENCH_REPETITIONS - 1) / 2] + ns[BENCH_REPETITIONS / 2]) / 2;
+    double stddev = sqrt(variance);
+    double rate = median > 0 ? b->bytes / median * 1e3 : 0;
+
+    if (bench_json) {
+        fprintf(bench_out, "{\"name\":\"%s\",\"ops\":%zu,\"repetitions\":%d,\"bytes_per_op\":%zu,"
+                "\"ns_per_op\":{\"min\":%.1f,\"median\":%.1f,\"mean\":%.1f,\"stddev\":%.1f},\"mb_per_s\":%.1f}\n",
+                b->name, b->ops, BENCH_REPETITIONS, b->bytes, ns[0], median, mean, stddev, rate);
+    } else {
+        fprintf(bench_out, "%-34s %14.1f ns/op %6.1f%% %10.1f MB/s\n", b->name, median, mean ? stddev / mean * 100 : 0, rate);
+    }
+    fflush(bench_out);
+}
+
+// time the repetition that just ended and start the next, false once done
+static bool bench_next(Bench *b) {
+    double t = now();
+
+    if (b->skip) {
+        return false;
+    }
+
+    if (b->rep >= 0) {
+        b->samples[b->rep] = t - b->start;
+    }
+
+    if (++b->rep == BENCH_REPETITIONS) {
+        bench_report(b);
+        return false;
+    }
+
+    b->start = now();
+    return true;
+}
+
+static void blit_per_pixel(FrameBuffer *fb, const uint16_t *src, size_t src_w, size_t src_h, size_t left, size_t top) {
+    size_t i = 0;
+    for (size_t y = 0; y < src_h; y++) {
+        for (size_t x = 0; x < src_w; x++) {
+            if (x < fb->w && y < fb->h) {
+                fb_set_pixel(fb, x + left, y + top, src[i]);
+                i++;
+            }
+        }
+    }
+}
+
+static void bench_png_blit(const PixelFormat *fmt) {
+    FrameBuffer *fb = fb_init_headless(BENCH_W, BENCH_H, fmt);
+    uint8_t *image = malloc(BENCH_W * BENCH_H * fmt->Bpp);
+    uint8_t *alpha = malloc(BENCH_W * BENCH_H);
+    size_t bytes = BENCH_W * BENCH_H * fmt->Bpp;
+    Bench b;
+
+    if (!fb || !image || !alpha) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < BENCH_W * BENCH_H; i++) {
+        fmt->put(image + i * fmt->Bpp, fmt->rgb(rand(), rand(), rand()));
+        alpha[i] = rand();
+    }
+
+    // baseline: the png loop widget_draw() used before fb_blit()
+    if (fmt == &pixel_format_rgb565) {
+        for (bench_start(&b, BENCH_OPS, bytes, "png per-pixel rgb565"); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                blit_per_pixel(fb, (uint16_t *)image, BENCH_W, BENCH_H, 0, 0);
+            }
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS, bytes, "png blit opaque %s", fmt->name); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            fb_blit(fb, image, NULL, BENCH_W, BENCH_H, 0, 0);
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS, bytes, "png blit alpha %s", fmt->name); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            fb_blit(fb, image, alpha, BENCH_W, BENCH_H, 0, 0);
+        }
+    }
+
+    cleanup:
+    if (image) {
+        free(image);
+    }
+    if (alpha) {
+        free(alpha);
+    }
+    if (fb) {
+        fb_deinit(fb);
+    }
+}
+
+static void bench_primitives(const PixelFormat *fmt) {
+    FrameBuffer *fb = fb_init_headless(BENCH_W, BENCH_H, fmt);
+    const SimdOps *variants[4];
+    size_t count = simd_variants(variants, 4);
+    const SimdOps *selected = simd;
+    Bench b;
+
+    if (!fb) {
+        return;
+    }
+
+    for (size_t v = 0; v < count; v++) {
+        simd = variants[v];
+        uint32_t color = fmt->rgb(0x7a, 0xef, 0xb2);
+
+        for (bench_start(&b, BENCH_OPS, fb->w * fb->h * fb->Bpp, "fill rect %s %s", fmt->name, simd->name); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                fb_fill_rect(fb, 0, 0, fb->w, fb->h, color);
+            }
+        }
+
+        // graph sized spans, the common case for borders
+        for (bench_start(&b, BENCH_OPS, fb->h * 45 * fb->Bpp, "hspan 45px %s %s", fmt->name, simd->name); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                for (size_t y = 0; y < fb->h; y++) {
+                    fb_hspan(fb, y % 64, y, 45, color);
+                }
+            }
+        }
+
+        for (bench_start(&b, BENCH_OPS, fb->w * 45 * fb->Bpp, "vspan 45px %s %s", fmt->name, simd->name); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                for (size_t x = 0; x < fb->w; x++) {
+                    fb_vspan(fb, x, x % 64, 45, color);
+                }
+            }
+        }
+
+        for (bench_start(&b, BENCH_OPS, fb->sz, "copy rect %s %s", fmt->name, simd->name); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                fb_restore_background(fb);
+            }
+        }
+
+        fb->upload = simd->stream;
+        for (bench_start(&b, BENCH_OPS, fb->sz, "swap stream %s %s", fmt->name, simd->name); bench_next(&b);) {
+            for (size_t i = 0; i < b.ops; i++) {
+                memset(fb->damage, DAMAGE_CURRENT, fb->h);
+                fb_swap(fb);
+            }
+        }
+    }
+
+    simd = selected;
+    fb_deinit(fb);
+}
+
+// a grid of graphs with value and text labels, like config.json but bigger
+static bool write_layout(const char *filename, bool font) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        return false;
+    }
+
+    fprintf(fp, "{\n\"fonts\": [%s],\n\"widgets\": [\n", font ? "{\"filename\": \"" BENCH_FONT "\", \"size\": 25}" : "");
+    for (int i = 0; i < BENCH_WIDGETS; i++) {
+        const char *type = !font || i % 10 < 7 ? "graph" : i % 10 < 9 ? "value" : "text";
+        fprintf(fp, "%s{\"type\": \"%s\", \"top\": %d, \"left\": %d, \"width\": 45, \"height\": 45, "
+                    "\"min\": 0, \"max\": 100, \"border_color\": \"#78D9FB\", \"line_color\": \"#7AEFB2\", "
+                    "\"identifier\": \"/bench/%d/load/%d\"%s%s}\n",
+                i ? "," : "", type, (i / 40) * 45, (i % 40) * 45, i / 8, i % 8,
+                strcmp(type, "graph") ? ", \"font\": \"" BENCH_FONT "\"" : "",
+                strcmp(type, "text") ? "" : ", \"text\": \"Utilization\"");
+    }
+    fprintf(fp, "]\n}\n");
+
+    return fclose(fp) == 0;
+}
+
+static void bench_config_startup(const PixelFormat *fmt) {
+    char json[64], snapshot[64];
+    bool font = access(BENCH_FONT, R_OK) == 0;
+    Font held = {0};
+    bool reused;
+    Bench b;
+
+    config_asset_report = false;
+    struct stat st;
+
+    snprintf(json, sizeof(json), "/tmp/rtop-bench-%d.json", getpid());
+    snprintf(snapshot, sizeof(snapshot), "/tmp/rtop-bench-%d.bin", getpid());
+
+    // keep the face loaded so both paths only pay for a refcount
+    if (font && !font_acquire(&held, BENCH_FONT, 25, &reused)) {
+        font = false;
+    }
+
+    if (!write_layout(json, font) || compile_config(json, snapshot) != 0 || stat(json, &st) != 0) {
+        fprintf(stderr, "Error: Could not write benchmark config\n");
+        goto cleanup;
+    }
+
+    for (bench_start(&b, BENCH_OPS, st.st_size, "config json %d widgets", BENCH_WIDGETS); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            Config config = {0};
+            if (load_config(json, &config, fmt, NULL) != 0) {
+                fprintf(stderr, "Error: Could not load benchmark config\n");
+            }
+            unload_config(&config);
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS, st.st_size, "config snapshot %d widgets", BENCH_WIDGETS); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            Config config = {0};
+            if (load_config_snapshot(snapshot, json, &config, fmt) != 0) {
+                fprintf(stderr, "Error: Could not load benchmark snapshot\n");
+            }
+            unload_config(&config);
+        }
+    }
+
+    cleanup:
+    config_asset_report = true;
+    unlink(json);
+    unlink(snapshot);
+    font_release(&held);
+}
+
+// translucent gradient with noise, so it neither compresses away nor is opaque
+static bool write_png(const char *filename, int seed, int width, int height) {
+    FILE *fp = fopen(filename, "wb");
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+    uint8_t *row = malloc(width * 4);
+    bool ok = false;
+
+    if (!fp || !info_ptr || !row || setjmp(png_jmpbuf(png_ptr))) {
+        goto cleanup;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            row[x * 4 + 0] = x + seed;
+            row[x * 4 + 1] = y;
+            row[x * 4 + 2] = rand() & 0x1f;
+            row[x * 4 + 3] = x + y;
+        }
+        png_write_row(png_ptr, row);
+    }
+    png_write_end(png_ptr, NULL);
+    ok = true;
+
+    cleanup:
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    free(row);
+    if (fp) {
+        ok &= fclose(fp) == 0;
+    }
+    return ok;
+}
+
+static void bench_asset_loading(const PixelFormat *fmt) {
+    char json[64], pngs[BENCH_PNGS][64] = {{0}};
+    bool font = access(BENCH_FONT, R_OK) == 0;
+    size_t bytes = 0;
+    FILE *fp = NULL;
+    Bench b;
+
+    // no cache directory, so every load decodes
+    unsetenv(IMAGE_CACHE_DIR_ENV);
+    unsetenv("XDG_CACHE_HOME");
+    unsetenv("HOME");
+
+    snprintf(json, sizeof(json), "/tmp/rtop-bench-%d.json", getpid());
+    for (int i = 0; i < BENCH_PNGS; i++) {
+        snprintf(pngs[i], sizeof(pngs[i]), "/tmp/rtop-bench-%d-%d.png", getpid(), i);
+        if (!write_png(pngs[i], i, BENCH_PNG_W, BENCH_PNG_H)) {
+            fprintf(stderr, "Error: Could not write benchmark png\n");
+            goto cleanup;
+        }
+        bytes += BENCH_PNG_W * BENCH_PNG_H * fmt->Bpp;
+    }
+
+    fp = fopen(json, "w");
+    if (!fp) {
+        goto cleanup;
+    }
+    fprintf(fp, "{\"fonts\": [%s], \"pngs\": [", font ? "{\"filename\": \"" BENCH_FONT "\", \"size\": 25}" : "");
+    for (int i = 0; i < BENCH_PNGS; i++) {
+        fprintf(fp, "%s{\"filename\": \"%s\"}", i ? ", " : "", pngs[i]);
+    }
+    fprintf(fp, "], \"widgets\": []}\n");
+    fclose(fp);
+
+    config_asset_report = false;
+    size_t thread_counts[] = {1, BENCH_PNGS};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        config_asset_threads = thread_counts[t];
+        for (bench_start(&b, 1, bytes, "assets %d pngs %zu threads", BENCH_PNGS, thread_counts[t]); bench_next(&b);) {
+            Config config = {0};
+            if (load_config(json, &config, fmt, NULL) != 0) {
+                fprintf(stderr, "Error: Could not load benchmark config\n");
+            }
+            unload_config(&config);
+        }
+    }
+    config_asset_threads = 0;
+    config_asset_report = true;
+
+    cleanup:
+    unlink(json);
+    for (int i = 0; i < BENCH_PNGS; i++) {
+        if (pngs[i][0]) {
+            unlink(pngs[i]);
+        }
+    }
+}
+
+// sustained appends to the history file, one value per identifier per round
+// as a packet a second would bring, with the periodic msync included
+static void bench_history_store() {
+    char filename[64], identifier[64];
+    HistorySlot **slots = calloc(BENCH_HISTORY_IDS, sizeof(HistorySlot *));
+    HistoryStore *store = NULL;
+    Bench b;
+
+    snprintf(filename, sizeof(filename), "/tmp/rtop-bench-%d.history", getpid());
+    store = history_store_open(filename, BENCH_HISTORY_IDS * 2, BENCH_HISTORY_SAMPLES);
+    if (!store || !slots) {
+        fprintf(stderr, "Error: Could not open benchmark history file\n");
+        goto cleanup;
+    }
+
+    // claiming every slot of an empty table, as on first start
+    for (bench_start(&b, 1, BENCH_HISTORY_IDS * sizeof(HistorySlot), "history bind %d ids", BENCH_HISTORY_IDS); bench_next(&b);) {
+        memset(store->slots, 0, sizeof(HistorySlot) * store->header->slot_count);
+        store->header->slots_used = 0;
+        for (int i = 0; i < BENCH_HISTORY_IDS; i++) {
+            snprintf(identifier, sizeof(identifier), "/bench/%d/load/%d", i / 8, i % 8);
+            slots[i] = history_store_slot(store, identifier);
+        }
+    }
+
+    // first pass faults the rings in, binding first if that was filtered out
+    for (int i = 0; i < BENCH_HISTORY_IDS; i++) {
+        if (!slots[i]) {
+            snprintf(identifier, sizeof(identifier), "/bench/%d/load/%d", i / 8, i % 8);
+            slots[i] = history_store_slot(store, identifier);
+        }
+        history_store_append(store, slots[i], 0, i);
+    }
+
+    int round = 0;
+    for (bench_start(&b, BENCH_OPS, BENCH_HISTORY_IDS * sizeof(HistoryPoint), "history append %d ids", BENCH_HISTORY_IDS); bench_next(&b);) {
+        for (size_t r = 0; r < b.ops; r++, round++) {
+            for (int i = 0; i < BENCH_HISTORY_IDS; i++) {
+                history_store_append(store, slots[i], round, i + round);
+            }
+            history_store_sync(store, round);
+        }
+    }
+
+    cleanup:
+    history_store_close(store);
+    unlink(filename);
+    free(slots);
+}
+
+// A packet as the sender builds it: an object per sensor identifier with the
+// value and some fields rtop ignores, for every widget of the benchmark layout
+// plus identifiers nothing routes to.
+static char *write_payload(size_t *length) {
+    size_t capacity = (BENCH_WIDGETS + BENCH_UNKNOWN_IDS) * 160 + 16, len = 0;
+    char *payload = malloc(capacity);
+
+    if (!payload) {
+        return NULL;
+    }
+
+    len += snprintf(payload + len, capacity - len, "{");
+    for (int i = 0; i < BENCH_WIDGETS + BENCH_UNKNOWN_IDS; i++) {
+        len += snprintf(payload + len, capacity - len,
+                        "%s\"/%s/%d/load/%d\": {\"Text\": \"CPU Core #%d\", \"Value\": %.6f, \"Min\": 0.0, \"Max\": 100.0, \"Type\": \"Load\"}",
+                        i ? ", " : "", i < BENCH_WIDGETS ? "bench" : "other", i / 8, i % 8, i % 8, (rand() % 100000) / 1000.0);
+    }
+    len += snprintf(payload + len, capacity - len, "}");
+
+    *length = len;
+    return payload;
+}
+
+// the listener and render loop steps of one packet: crc, inflate, json decode
+// and routing into the benchmark layout
+static void bench_ingest(const PixelFormat *fmt) {
+    char json[64];
+    bool font = access(BENCH_FONT, R_OK) == 0;
+    size_t length = 0, packet_length = 0, bound = 0;
+    char *payload = write_payload(&length);
+    uint8_t *packet = NULL, *output = NULL;
+    Config config = {0};
+    double time = 0;
+    Bench b;
+
+    snprintf(json, sizeof(json), "/tmp/rtop-bench-%d.json", getpid());
+    config_asset_report = false;
+
+    if (!payload || !write_layout(json, font) || load_config(json, &config, fmt, NULL) != 0) {
+        fprintf(stderr, "Error: Could not set up ingest benchmark\n");
+        goto cleanup;
+    }
+
+    // raw deflate, as the sender compresses
+    z_stream stream = {0};
+    bound = compressBound(length);
+    packet = malloc(bound);
+    output = malloc(MAX_PAYLOAD_LEN);
+    if (!packet || !output || deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        goto cleanup;
+    }
+    stream.next_in = (Bytef *)payload;
+    stream.avail_in = length;
+    stream.next_out = packet;
+    stream.avail_out = bound;
+    deflate(&stream, Z_FINISH);
+    packet_length = stream.total_out;
+    deflateEnd(&stream);
+
+    if (length >= MAX_PAYLOAD_LEN || packet_length > MAX_PAYLOAD_LEN) {
+        fprintf(stderr, "Error: Benchmark payload too large\n");
+        goto cleanup;
+    }
+
+    volatile uint32_t crc = 0;
+    for (bench_start(&b, BENCH_OPS * 10, packet_length, "crc32 packet %zu bytes", packet_length); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            crc += _crc32(packet, packet_length);
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS * 10, packet_length, "inflate packet %zu bytes", packet_length); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            size_t output_length = MAX_PAYLOAD_LEN - 1;
+            inflate_buffer(packet, packet_length, output, &output_length);
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS * 10, length, "json decode %d ids", BENCH_WIDGETS + BENCH_UNKNOWN_IDS); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            free(json_parse(payload, length));
+        }
+    }
+
+    // the render loop parses into one reused buffer
+    IngestParse parse = {0};
+    for (bench_start(&b, BENCH_OPS * 10, length, "json decode reused %d ids", BENCH_WIDGETS + BENCH_UNKNOWN_IDS); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            ingest_parse(&parse, payload, length);
+        }
+    }
+
+    size_t routed = 0;
+    for (bench_start(&b, BENCH_OPS * 10, length, "json decode+route %d ids", BENCH_WIDGETS + BENCH_UNKNOWN_IDS); bench_next(&b);) {
+        for (size_t i = 0; i < b.ops; i++) {
+            struct json_value_s *root = ingest_parse(&parse, payload, length);
+            routed += ingest_route(&config, NULL, root, time++, NULL);
+        }
+    }
+    ingest_parse_free(&parse);
+
+    if (!routed && !b.skip) {
+        fprintf(stderr, "Error: Benchmark payload routed nowhere\n");
+    }
+
+    cleanup:
+    config_asset_report = true;
+    unload_config(&config);
+    unlink(json);
+    free(payload);
+    free(packet);
+    free(output);
+}
+
+// one widget of each type, drawn as the render loop would every frame
+static bool write_render_layout(const char *filename, const char *png, bool font) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        return false;
+    }
+
+    fprintf(fp, "{\"fonts\": [%s], \"pngs\": [{\"filename\": \"%s\"}], \"widgets\": [\n", font ? "{\"filename\": \"" BENCH_FONT "\", \"size\": 25}" : "", png);
+    fprintf(fp, "{\"type\": \"graph\", \"top\": 0, \"left\": 0, \"width\": 359, \"height\": 100, \"min\": 0, \"max\": 100, "
+                "\"scale\": 1, \"border_color\": \"#78D9FB\", \"line_color\": \"#7AEFB2\", \"identifier\": \"/bench/graph\"},\n");
+    fprintf(fp, "{\"type\": \"graph\", \"top\": 100, \"left\": 0, \"width\": 359, \"height\": 100, \"min\": 0, \"max\": 100, "
+                "\"window\": 3600, \"border_color\": \"#78D9FB\", \"line_color\": \"#7AEFB2\", \"identifier\": \"/bench/window\"},\n");
+    fprintf(fp, "{\"type\": \"png\", \"top\": 200, \"left\": 0, \"png\": \"%s\"}", png);
+    if (font) {
+        fprintf(fp, ",\n{\"type\": \"value\", \"top\": 300, \"left\": 0, \"precision\": 2, \"font\": \"" BENCH_FONT "\", "
+                    "\"line_color\": \"#B04E3B\", \"identifier\": \"/bench/value\"},\n");
+        fprintf(fp, "{\"type\": \"text\", \"top\": 330, \"left\": 0, \"font\": \"" BENCH_FONT "\", \"line_color\": \"#7AEFB2\", \"text\": \"Utilization\"},\n");
+        fprintf(fp, "{\"type\": \"stats\", \"top\": 360, \"left\": 0, \"font\": \"" BENCH_FONT "\", \"line_color\": \"#FFFFFF\"}");
+    }
+    fprintf(fp, "]}\n");
+
+    return fclose(fp) == 0;
+}
+
+static void bench_render(const PixelFormat *fmt) {
+    char json[64], png[64];
+    bool font = access(BENCH_FONT, R_OK) == 0;
+    FrameBuffer *fb = fb_init_headless(BENCH_W, BENCH_H, fmt);
+    StatsReport report = {0};
+    Config config = {0};
+    double time = 1e9;
+    Bench b;
+
+    snprintf(json, sizeof(json), "/tmp/rtop-bench-%d-render.json", getpid());
+    snprintf(png, sizeof(png), "/tmp/rtop-bench-%d-render.png", getpid());
+    config_asset_report = false;
+
+    if (!fb || !write_png(png, 0, 200, 100) || !write_render_layout(json, png, font) || load_config(json, &config, fmt, NULL) != 0) {
+        fprintf(stderr, "Error: Could not set up render benchmark\n");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < config.widget_count; i++) {
+        Widget *w = &config.widgets[i];
+        if (w->kind != WIDGET_GRAPH) {
+            continue;
+        }
+
+        const char *name = w->window ? "log push graph window" : "log push graph";
+        for (bench_start(&b, BENCH_MICRO_OPS, sizeof(double), "%s", name); bench_next(&b);) {
+            for (size_t j = 0; j < b.ops; j++) {
+                widget_log_push(w, rand() % 100, time++);
+            }
+        }
+    }
+
+    stats_report_update(&report, 1, "/bench/graph", 1000);
+
+    for (size_t i = 0; i < config.widget_count; i++) {
+        Widget *w = &config.widgets[i];
+        size_t bytes = w->png ? w->png->width * w->png->height * fmt->Bpp : w->width * w->height * fmt->Bpp;
+        const char *type = w->kind == WIDGET_GRAPH && w->window ? "graph window" : w->type;
+
+        for (bench_start(&b, BENCH_OPS * 10, bytes, "draw %s %s", type, fmt->name); bench_next(&b);) {
+            for (size_t j = 0; j < b.ops; j++) {
+                if (w->kind == WIDGET_GRAPH || w->kind == WIDGET_VALUE) {
+                    widget_draw(w, 42.42, time, false, fb);
+                } else if (w->kind == WIDGET_STATS) {
+                    widget_draw_lines(w, report.text, fb);
+                } else {
+                    widget_draw_static(w, fb);
+                }
+            }
+        }
+    }
+
+    if (font) {
+        const char *text = "FPS: 59.94 UP: 1234 MB/s";
+        for (bench_start(&b, BENCH_OPS * 10, strlen(text), "ft draw string %zu chars %s", strlen(text), fmt->name); bench_next(&b);) {
+            for (size_t j = 0; j < b.ops; j++) {
+                ft_draw_string(&config.fonts[0], fb, text, 360, 680, fb_rgb(fb, 0xff, 0xff, 0xff));
+            }
+        }
+    }
+
+    // the upload the framebuffer calibrated, for a full frame and for the
+    // rows of one graph
+    for (bench_start(&b, BENCH_OPS, fb->sz, "fb swap full %s", fmt->name); bench_next(&b);) {
+        for (size_t j = 0; j < b.ops; j++) {
+            memset(fb->damage, DAMAGE_CURRENT, fb->h);
+            fb_swap(fb);
+        }
+    }
+
+    for (bench_start(&b, BENCH_OPS * 10, fb->sz / fb->h * 100, "fb swap 100 rows %s", fmt->name); bench_next(&b);) {
+        for (size_t j = 0; j < b.ops; j++) {
+            memset(fb->damage, 0, fb->h);
+            memset(fb->damage, DAMAGE_CURRENT, 100);
+            fb_swap(fb);
+        }
+    }
+
+    cleanup:
+    config_asset_report = true;
+    unload_config(&config);
+    if (fb) {
+        fb_deinit(fb);
+    }
+    unlink(json);
+    unlink(png);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            bench_json = true;
+        } else {
+            bench_filter = argv[i];
+        }
+    }
+
+    bench_out = stdout;
+    if (bench_json) {
+        int fd = dup(STDOUT_FILENO);
+        bench_out = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (bench_out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("Error: Could not redirect stdout");
+            return EXIT_FAILURE;
+        }
+        fprintf(bench_out, "{\"version\":\"%s\",\"width\":%d,\"height\":%d,\"warmup\":%d,\"repetitions\":%d}\n",
+                RTOP_VERSION, BENCH_W, BENCH_H, BENCH_WARMUP, BENCH_REPETITIONS);
+    } else {
+        fprintf(bench_out, "rtop %s, %dx%d, %d warmup + %d repetitions, median ns/op and relative stddev\n",
+                RTOP_VERSION, BENCH_W, BENCH_H, BENCH_WARMUP, BENCH_REPETITIONS);
+    }
+
+    bench_png_blit(&pixel_format_rgb565);
+    bench_png_blit(&pixel_format_xrgb8888);
+    bench_png_blit(&pixel_format_bgr888);
+    bench_primitives(&pixel_format_rgb565);
+    bench_primitives(&pixel_format_xrgb8888);
+    bench_config_startup(&pixel_format_xrgb8888);
+    bench_asset_loading(&pixel_format_xrgb8888);
+    bench_history_store();
+    bench_ingest(&pixel_format_xrgb8888);
+    bench_render(&pixel_format_rgb565);
+    bench_render(&pixel_format_xrgb8888);
+    font_manager_shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct _ArenaBlock {
+    struct _ArenaBlock *next;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+} ArenaBlock;
+
+// Bump allocator for everything a config owns; allocations are zeroed and
+// live until arena_free(). block_size, if set, sizes the next block.
+typedef struct _Arena {
+    ArenaBlock *blocks;
+    size_t block_size;
+    size_t allocated;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *s);
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _ASSET_H_
+#define _ASSET_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// identifies the version of a file an asset was loaded from
+typedef struct AssetStamp {
+    struct timespec mtime;
+    off_t size;
+} AssetStamp;
+
+bool asset_stamp(const char *filename, AssetStamp *stamp);
+bool asset_unchanged(const char *filename, const AssetStamp *stamp);
+
+#endif
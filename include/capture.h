@@ -0,0 +1,47 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#define CAPTURE_MAGIC 0x50414352 // "RCAP"
+#define CAPTURE_VERSION 2
+
+typedef struct _CaptureHeader {
+    uint32_t magic;
+    uint32_t version;
+} CaptureHeader;
+
+// one packet, its raw bytes as received follow
+typedef struct _CaptureRecord {
+    // wall clock ns it was received at
+    uint64_t time_ns;
+    uint32_t length;
+    // sender IPv4 address and port, network order
+    uint32_t addr;
+    uint16_t port;
+    uint16_t reserved;
+    uint32_t reserved2;
+} CaptureRecord;
+
+// A file of validated packets exactly as they came off the socket, each
+// after a record header. Recording appends to an existing capture.
+typedef struct _Capture {
+    char *filename;
+    FILE *fp;
+    bool writing;
+    // a write failed, nothing more is recorded
+    bool failed;
+    size_t packets;
+} Capture;
+
+Capture *capture_open(const char *filename, bool writing);
+int capture_write(Capture *c, const uint8_t *packet, size_t length, uint64_t time_ns, const struct sockaddr_in *from);
+int capture_read(Capture *c, uint8_t *packet, size_t capacity, size_t *length, uint64_t *time_ns, struct sockaddr_in *from);
+void capture_close(Capture *c);
+
+#endif
@@ -7,6 +7,10 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <png.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include <freetype2/ft2build.h>
 #include <freetype/freetype.h>
@@ -14,25 +18,87 @@
 #include "json.h"
 #include "ft.h"
 #include "widgets.h"
+#include "imgcache.h"
+#include "arena.h"
 
 #define MAX_WIDTH 10000
 #define MAX_HEIGHT 10000
 #define HEADER_SIZE 8
+#define ASSET_THREADS_MAX 16
 
 typedef struct Config {
+    // owns the arrays below, their strings, the hot fields and the index
+    Arena arena;
     // widgets
     Widget *widgets;
     size_t widget_count;
+    size_t widget_capacity;
+    WidgetHot hot;
     // fonts
-    FT_Library ft;
     Font *fonts;
     size_t font_count;
+    size_t font_capacity;
     // pngs
     Png *pngs;
     size_t png_count;
+    size_t png_capacity;
+    // pixel format colors and images are stored in
+    const PixelFormat *fmt;
+    // assets carried over from the live config on reload
+    size_t fonts_reused;
+    size_t pngs_reused;
+    // optional history file, "history": {"file", "identifiers", "samples"}
+    char *history_file;
+    size_t history_slots;
+    size_t history_samples;
+    // optional stats endpoint, "export": {"socket", "port"}
+    char *export_socket;
+    uint16_t export_port;
+    // identifier hash index, see config_find_widget()
+    uint32_t *index;
+    size_t index_mask;
+    // set when loaded from a compiled snapshot, which the index and widget
+    // strings point into instead of the arena
+    uint8_t *map;
+    size_t map_len;
 } Config;
 
-int load_config(const char *filename, Config *config);
+// threads loading fonts and pngs, 0 for one per online cpu
+extern size_t config_asset_threads;
+// print per-asset load times
+extern bool config_asset_report;
+
+// one font or png for the asset pool to load into its slot of the config
+typedef struct _AssetJob {
+    bool font;
+    size_t slot;
+    const char *source;
+    double ms;
+    int ret;
+} AssetJob;
+
+typedef struct _AssetPool {
+    Config *config;
+    const Config *live;
+    AssetJob *jobs;
+    size_t job_count;
+    size_t next;
+    pthread_mutex_t mutex;
+} AssetPool;
+
+int load_config(const char *filename, Config *config, const PixelFormat *fmt, const Config *live);
+size_t config_adopt(Config *config, Config *old);
+int config_reserve(Config *config, size_t widgets, size_t fonts, size_t pngs);
+int config_build_hot(Config *config);
+int config_init_history(Config *config);
+int config_add_font(Config *config, const char *filename, size_t size);
+int config_add_png(Config *config, const char *filename);
+int config_load_assets(Config *config, const Config *live);
+uint32_t config_hash(const char *s);
+int config_build_index(Config *config);
+Widget *config_find_widget(const Config *config, const char *identifier);
+int decode_png(const char *filename, const PixelFormat *fmt, Png *png);
+void png_release(Png *png);
 void unload_config(Config *config);
 
 #endif
\ No newline at end of file
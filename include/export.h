@@ -0,0 +1,69 @@
+#ifndef _EXPORT_H_
+#define _EXPORT_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "ingest.h"
+#include "stats.h"
+
+#define EXPORT_BACKLOG 4
+#define EXPORT_REQUEST_MAX 4096
+#define EXPORT_TIMEOUT_MS 1000
+
+// growable text, owned by whichever side holds it
+typedef struct _ExportText {
+    char *data;
+    size_t len;
+    size_t capacity;
+} ExportText;
+
+// Serves the stats counters, stage histograms, per-sender counters and the
+// current value of every routed identifier in Prometheus text format on a
+// Unix socket and/or a loopback TCP port, from an idle priority thread. The
+// render loop publishes identifier values with exporter_publish() into a
+// triple buffer: each side owns one buffer and swaps it with the shared middle
+// one by an atomic exchange, so neither ever waits on the other.
+typedef struct _Exporter {
+    char *socket_path;
+    uint16_t port;
+    int fds[2];
+    size_t fd_count;
+    ExportText buffers[3];
+    // written by the render loop
+    ExportText *back;
+    // read by the export thread
+    ExportText *front;
+    // the third buffer, its low bit set when it holds values not yet taken
+    _Atomic uintptr_t middle;
+    ExportText response;
+    // per-source counters of each listener
+    Ingest *ingests[INGEST_LISTENERS_MAX];
+    size_t ingest_count;
+} Exporter;
+
+extern volatile bool running;
+
+Exporter *exporter_open(const char *socket_path, uint16_t port, Ingest **ingests, size_t ingest_count);
+void exporter_close(Exporter *e);
+void exporter_publish(Exporter *e, const Config *config);
+void *stats_exporter(void *arg);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -11,6 +12,14 @@
 #include <linux/fb.h>
 #include <sys/kd.h>
 #include <sys/mman.h>
+#include <time.h>
+
+#include "pixel.h"
+#include "simd.h"
+
+// per row damage flags, rows drawn in this or the previous frame are uploaded
+#define DAMAGE_CURRENT 1
+#define DAMAGE_PREVIOUS 2
 
 typedef struct _FrameBuffer {
     int fd;
@@ -24,16 +33,33 @@ typedef struct _FrameBuffer {
     size_t stride;
     size_t slop;
     uint8_t *bb;
+    uint8_t *bg;
+    bool headless;
+    const PixelFormat *fmt;
+    // upload to device memory
+    uint8_t *damage;
+    const char *upload_name;
+    void (*upload)(uint8_t *dst, const uint8_t *src, size_t n);
+    uint64_t upload_bytes;
+    uint64_t upload_ns;
 } FrameBuffer;
 
-uint16_t rgb_to_rgb565(uint8_t r, uint8_t g, uint8_t b);
-
 FrameBuffer* fb_init();
+FrameBuffer* fb_init_headless(size_t w, size_t h, const PixelFormat *fmt);
 void fb_set_graphics_mode();
 void fb_clear(FrameBuffer *fb);
-void fb_draw_line(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint16_t rgb565);
-void fb_draw_line_shaded(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint16_t line_color, uint16_t shade_color);
-void fb_set_pixel(FrameBuffer *fb, size_t x, size_t y, uint16_t rgb565);
+void fb_save_background(FrameBuffer *fb);
+void fb_restore_background(FrameBuffer *fb);
+uint32_t fb_rgb(FrameBuffer *fb, uint8_t r, uint8_t g, uint8_t b);
+void fb_draw_line(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint32_t color);
+void fb_draw_line_shaded(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint32_t line_color, uint32_t shade_color);
+void fb_fill_rect(FrameBuffer *fb, size_t x, size_t y, size_t w, size_t h, uint32_t color);
+void fb_hspan(FrameBuffer *fb, size_t x, size_t y, size_t n, uint32_t color);
+void fb_vspan(FrameBuffer *fb, size_t x, size_t y, size_t n, uint32_t color);
+void fb_draw_mask(FrameBuffer *fb, const uint8_t *mask, size_t pitch, size_t w, size_t h, long x, long y, uint32_t color);
+void fb_set_pixel(FrameBuffer *fb, size_t x, size_t y, uint32_t color);
+void fb_blit(FrameBuffer *fb, const uint8_t *src, const uint8_t *alpha, size_t src_w, size_t src_h, size_t left, size_t top);
+void fb_calibrate_upload(FrameBuffer *fb);
 void fb_swap(FrameBuffer *fb);
 void fb_deinit(FrameBuffer *fb);
 
@@ -5,15 +5,52 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include <freetype2/ft2build.h>
 #include <freetype/freetype.h>
+#include <freetype/ftsizes.h>
 
 #include "fb.h"
+#include "asset.h"
 
 static const int32_t utf32_space[2] = {' ', 0};
 
-void ft_draw_string(FT_Face face, FrameBuffer *fb, const char *s, size_t x, size_t y, uint16_t color);
-bool ft_init(const char* ttf_file, FT_Face* face, FT_Library* ft, int req_size);
+// one pixel size instantiated on a shared face
+typedef struct _FontSize {
+    size_t px;
+    FT_Size size;
+    size_t refs;
+    struct _FontSize *next;
+} FontSize;
+
+// a font file, memory mapped and opened once for every size and config using it
+typedef struct _FontFile {
+    char *filename;
+    AssetStamp stamp;
+    uint8_t *map;
+    size_t map_len;
+    FT_Face face;
+    FontSize *sizes;
+    size_t refs;
+    struct _FontFile *next;
+} FontFile;
+
+typedef struct Font {
+    char *filename;
+    size_t size;
+    FontFile *file;
+    FontSize *sized;
+} Font;
+
+bool font_acquire(Font *font, const char *filename, size_t size, bool *reused);
+void font_release(Font *font);
+void font_manager_shutdown();
+size_t ft_line_height(Font *font);
+void ft_draw_string(Font *font, FrameBuffer *fb, const char *s, size_t x, size_t y, uint32_t color);
 
 #endif
\ No newline at end of file
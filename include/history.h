@@ -0,0 +1,55 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "arena.h"
+
+#define HISTORY_LEVELS 4
+// raw samples kept by graphs with a window, enough for 10 minutes at 1 Hz
+#define HISTORY_RAW_MIN 600
+#define HISTORY_LEVEL_MAX 4096
+
+// a raw sample (count 1) or a rollup bucket starting at time, in wall clock
+// seconds so stored history lines up across restarts
+typedef struct _Sample {
+    double time;
+    double min;
+    double max;
+    double sum;
+    uint32_t count;
+} Sample;
+
+// ring of samples or buckets, newest at head
+typedef struct _HistoryLevel {
+    double span;
+    Sample *ring;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} HistoryLevel;
+
+// Raw samples plus rollups into 10 s, 1 min and 10 min buckets, each updated
+// on push so a graph can show windows far longer than its width in samples.
+// Rollup levels only exist for graphs with a window longer than their span.
+typedef struct _History {
+    HistoryLevel levels[HISTORY_LEVELS];
+    size_t level_count;
+} History;
+
+int history_init(History *h, Arena *arena, size_t raw_capacity, double window);
+void history_push(History *h, double value, double time);
+void history_adopt(History *h, const History *old);
+const HistoryLevel *history_level_for(const History *h, double since);
+size_t history_count_since(const HistoryLevel *l, double since);
+
+// k-th newest entry of a level, k < count
+static inline const Sample *history_at(const HistoryLevel *l, size_t k) {
+    return &l->ring[(l->head + l->capacity - k) % l->capacity];
+}
+
+#endif
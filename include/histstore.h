@@ -0,0 +1,83 @@
+#ifndef _HISTSTORE_H_
+#define _HISTSTORE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#define HISTORY_STORE_MAGIC 0x54534948 // "HIST"
+#define HISTORY_STORE_VERSION 1
+#define HISTORY_STORE_SLOTS 512
+#define HISTORY_STORE_SAMPLES 3600
+#define HISTORY_STORE_SYNC_SECONDS 5
+#define HISTORY_IDENTIFIER_MAX 256
+
+typedef struct _HistoryStoreHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t capacity;
+    uint32_t slots_used;
+    uint32_t reserved;
+} HistoryStoreHeader;
+
+// one identifier; its ring of capacity points follows the slot table
+typedef struct _HistorySlot {
+    char identifier[HISTORY_IDENTIFIER_MAX];
+    uint32_t hash;
+    uint32_t head;
+    uint32_t count;
+    uint32_t reserved;
+} HistorySlot;
+
+typedef struct _HistoryPoint {
+    double time;
+    double value;
+} HistoryPoint;
+
+// File backed history: header, an open addressed table of slots keyed by
+// identifier, then one fixed size ring per slot. Appends only write to the
+// mapping; history_store_sync() msyncs it every HISTORY_STORE_SYNC_SECONDS.
+typedef struct _HistoryStore {
+    char *filename;
+    uint8_t *map;
+    size_t map_len;
+    HistoryStoreHeader *header;
+    HistorySlot *slots;
+    HistoryPoint *points;
+    double synced;
+    bool full_reported;
+} HistoryStore;
+
+HistoryStore *history_store_open(const char *filename, size_t slot_count, size_t capacity);
+void history_store_close(HistoryStore *store);
+HistorySlot *history_store_slot(HistoryStore *store, const char *identifier);
+void history_store_bind(HistoryStore *store, Config *config, bool replay);
+void history_store_sync(HistoryStore *store, double now);
+
+static inline HistoryPoint *history_store_ring(HistoryStore *store, HistorySlot *slot) {
+    return store->points + (size_t)(slot - store->slots) * store->header->capacity;
+}
+
+// the point is written before head and count, so a crash loses at most it
+static inline void history_store_append(HistoryStore *store, HistorySlot *slot, double time, double value) {
+    HistoryPoint *ring = history_store_ring(store, slot);
+    uint32_t head = slot->count ? (slot->head + 1) % store->header->capacity : 0;
+
+    ring[head].time = time;
+    ring[head].value = value;
+    slot->head = head;
+    if (slot->count < store->header->capacity) {
+        slot->count++;
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _IMGCACHE_H_
+#define _IMGCACHE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "widgets.h"
+
+#define IMAGE_CACHE_MAGIC 0x43495452 // "RTIC"
+#define IMAGE_CACHE_VERSION 1
+#define IMAGE_CACHE_DIR_ENV "RTOP_CACHE_DIR"
+
+// Header of a cached image: pixels in the named framebuffer format follow at
+// data_offset, the premultiplied alpha plane (if any) right after them.
+typedef struct _ImageCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    char format[16];
+    uint64_t hash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t has_alpha;
+    uint32_t data_offset;
+} ImageCacheHeader;
+
+bool image_cache_key(const char *filename, uint64_t *hash);
+int image_cache_load(uint64_t hash, const PixelFormat *fmt, Png *png);
+void image_cache_store(uint64_t hash, const PixelFormat *fmt, const Png *png);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "sock.h"
+#include "shared.h"
+#include "capture.h"
+#include "config.h"
+#include "histstore.h"
+#include "json.h"
+#include "stats.h"
+
+#define INGEST_SOURCES_MAX 256
+// listener threads, each with its own socket on the port
+#define INGEST_LISTENERS_MAX 16
+// a packet no newer than the last one after this long a silence from its
+// source means the sender restarted
+#define INGEST_RESTART_NS 2000000000ULL
+
+// how a listener takes datagrams off its socket
+typedef enum _IngestReceive {
+    // multishot recvmsg into registered buffers, recvfrom where unsupported
+    INGEST_RECEIVE_URING,
+    INGEST_RECEIVE_RECVFROM
+} IngestReceive;
+
+// One sender, known by its host id if its packets carry one and by its
+// address otherwise. Its name is what a widget's "source" is matched against:
+// the host id in decimal, or the dotted IPv4 address. Only the listener
+// writes a source; the counters are read by the stats exporter, and the name
+// changes only under Ingest.sources_mutex.
+typedef struct _IngestSource {
+    bool has_host_id;
+    uint32_t host_id;
+    // network order
+    uint32_t addr;
+    char name[SOURCE_NAME_MAX];
+    // inflate state kept for the sender's packets
+    z_stream stream;
+    // newest packet taken, by sequence number or else by timestamp
+    bool has_seq;
+    uint32_t seq;
+    bool has_timestamp;
+    uint64_t timestamp;
+    // bit k set once seq - k has arrived; a number is lost when it leaves
+    // the window without having arrived
+    uint64_t seen;
+    _Atomic uint64_t packets;
+    _Atomic uint64_t lost;
+    _Atomic uint64_t duplicates;
+    _Atomic uint64_t reordered;
+    // monotonic ns of its last packet, the least recent source makes room
+    // for a new one once the table is full
+    _Atomic uint64_t last_seen;
+} IngestSource;
+
+// Listener half of the pipeline, fed by the UDP socket or a replayed capture:
+// checks, records and inflates each packet and queues it for the render loop.
+// With more than one listener each has its own Ingest and SO_REUSEPORT socket
+// and the kernel spreads senders across them by address and port, so a
+// sender's packets stay with one listener and its sources and sequence
+// numbers are kept there.
+typedef struct _Ingest {
+    SharedQueue queue;
+    size_t listener;
+    size_t listeners;
+    IngestReceive receive;
+    // for the stats
+    char name[16];
+    // validated packets are appended here while recording
+    Capture *capture;
+    // wait for room in the queue instead of dropping packets
+    bool wait;
+    uint64_t seq;
+    IngestSource sources[INGEST_SOURCES_MAX];
+    // sources are added and renamed under the mutex
+    size_t source_count;
+    pthread_mutex_t sources_mutex;
+} Ingest;
+
+// render loop: the document parsed from the newest packet, in a buffer that
+// only ever grows, so parsing allocates nothing once it is big enough
+typedef struct _IngestParse {
+    void *data;
+    size_t capacity;
+} IngestParse;
+
+// replays a capture into an Ingest at its original pace, or as fast as the
+// render loop takes packets, then stops the program
+typedef struct _Replay {
+    Capture *capture;
+    Ingest *ingest;
+    bool fast;
+} Replay;
+
+extern volatile bool running;
+
+Ingest *ingest_open(size_t listener, size_t listeners);
+bool ingest_packet(Ingest *in, const uint8_t *packet, size_t length, const struct sockaddr_in *from);
+SharedQueue *ingest_next(Ingest **ingests, size_t count, size_t *next);
+struct json_value_s *ingest_parse(IngestParse *p, const char *payload, size_t size);
+void ingest_parse_free(IngestParse *p);
+void ingest_close(Ingest *in);
+size_t ingest_route(Config *config, HistoryStore *history, struct json_value_s *root, double received, const char *source);
+void *capture_replay(void *arg);
+
+#endif
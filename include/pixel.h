@@ -0,0 +1,42 @@
+#ifndef _PIXEL_H_
+#define _PIXEL_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/fb.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct _FrameBuffer;
+
+// Rendering kernels specialized for one framebuffer pixel layout. Colors are
+// passed around in the native layout (see rgb), so none of the kernels has to
+// branch on the format per pixel. The kernels are generated from
+// src/pixel_kernels.h and one descriptor is selected in fb_init().
+typedef struct _PixelFormat {
+    const char *name;
+    size_t bpp;
+    size_t Bpp;
+    uint32_t (*rgb)(uint8_t r, uint8_t g, uint8_t b);
+    void (*put)(uint8_t *dst, uint32_t color);
+    void (*hspan)(uint8_t *dst, size_t n, uint32_t color);
+    void (*vspan)(uint8_t *dst, size_t stride, size_t n, uint32_t color);
+    void (*draw_mask)(uint8_t *dst, size_t stride, const uint8_t *mask, size_t pitch, size_t w, size_t h, uint32_t color);
+    void (*draw_line)(struct _FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint32_t color);
+    void (*draw_line_shaded)(struct _FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint32_t line_color, uint32_t shade_color);
+    void (*blend_row)(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, size_t n);
+} PixelFormat;
+
+extern const PixelFormat pixel_format_rgb565;
+extern const PixelFormat pixel_format_xrgb8888;
+extern const PixelFormat pixel_format_bgr888;
+
+uint16_t rgb_to_rgb565(uint8_t r, uint8_t g, uint8_t b);
+
+const PixelFormat *pixel_format_from_var(const struct fb_var_screeninfo *vinfo);
+const PixelFormat *pixel_format_by_name(const char *name);
+
+#endif
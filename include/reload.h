@@ -0,0 +1,45 @@
+#ifndef _RELOAD_H_
+#define _RELOAD_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/inotify.h>
+
+#include "config.h"
+
+#define RELOAD_SETTLE_MS 100
+
+extern volatile bool running;
+
+typedef struct _Watch {
+    int wd;
+    char *name;
+} Watch;
+
+// Watches the config file and the fonts/pngs it references. Changes build a
+// new Config on the watcher thread, reusing unchanged assets of the live one;
+// the render loop swaps it in between frames with reloader_apply(). The mutex
+// is held for the whole build, so the live config never changes under it.
+typedef struct _Reloader {
+    const char *filename;
+    const PixelFormat *fmt;
+    const Config *live;
+    Config *pending;
+    double build_ms;
+    pthread_mutex_t mutex;
+    int fd;
+    Watch *watches;
+    size_t watch_count;
+} Reloader;
+
+void *config_watcher(void *arg);
+bool reloader_apply(Reloader *r, Config *config);
+
+#endif
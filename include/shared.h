@@ -1,14 +1,58 @@
 #ifndef _SHARED_H
 #define _SHARED_H
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "trace.h"
+
 #define SHARED_BUFFER_SIZE 65535
+// packets waiting for the render loop, which takes them all every frame
+#define SHARED_QUEUE_PACKETS 64
+#define SOURCE_NAME_MAX 32
+// how long a listener waiting for room sleeps between looks
+#define SHARED_QUEUE_WAIT_NS 100000
 
-typedef struct _SharedBuffer {
-    char buffer[SHARED_BUFFER_SIZE];
+// one inflated payload, written by the listener straight into the buffer of
+// the slot it reserved and read by the render loop from the same buffer
+typedef struct _SharedPacket {
+    char *buffer;
+    size_t capacity;
     size_t size;
-    bool data_available;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-} SharedBuffer;
+    // wall clock seconds the packet was received at
+    double received;
+    // name of the sender, see IngestSource
+    char source[SOURCE_NAME_MAX];
+    PacketTrace trace;
+} SharedPacket;
+
+// Bounded single producer, single consumer ring from one listener to the
+// render loop, whose slots are the only payload buffers: the listener
+// reserves the slot at head, inflates into it and commits it, and the render
+// loop peeks at the slot at tail and releases it once parsed. head counts
+// the packets committed and is written by the listener alone, tail the
+// packets released and is written by the render loop alone, so neither side
+// ever takes a lock; the two live on separate cache lines. A packet arriving
+// to a full queue is dropped, unless the listener asked to wait for room.
+typedef struct _SharedQueue {
+    SharedPacket packets[SHARED_QUEUE_PACKETS];
+    alignas(64) _Atomic size_t head;
+    alignas(64) _Atomic size_t tail;
+} SharedQueue;
+
+extern volatile bool running;
+
+SharedPacket *shared_queue_reserve(SharedQueue *q, bool wait);
+void shared_queue_commit(SharedQueue *q);
+SharedPacket *shared_queue_peek(SharedQueue *q);
+void shared_queue_release(SharedQueue *q);
+void shared_queue_drain(SharedQueue *q);
+void shared_queue_free(SharedQueue *q);
 
-#endif
\ No newline at end of file
+#endif
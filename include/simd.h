@@ -0,0 +1,27 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Bulk memory primitives used by the framebuffer code. One variant is picked
+// at startup by simd_init() based on what the cpu supports.
+typedef struct _SimdOps {
+    const char *name;
+    // fill n pixels with a 16 or 32 bit color pattern
+    void (*fill16)(uint8_t *dst, size_t n, uint16_t color);
+    void (*fill32)(uint8_t *dst, size_t n, uint32_t color);
+    // copy n bytes between system memory buffers
+    void (*copy)(uint8_t *dst, const uint8_t *src, size_t n);
+    // copy n bytes with non-temporal stores, for the final write to device memory
+    void (*stream)(uint8_t *dst, const uint8_t *src, size_t n);
+} SimdOps;
+
+extern const SimdOps *simd;
+
+void simd_init();
+size_t simd_variants(const SimdOps **variants, size_t max);
+
+#endif
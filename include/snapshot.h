@@ -0,0 +1,91 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "asset.h"
+
+#define SNAPSHOT_MAGIC 0x50414e53 // "SNAP"
+#define SNAPSHOT_VERSION 7
+#define SNAPSHOT_NONE 0xffffffff
+
+// Compiled config.json, written by rtop --compile-config and mapped at startup.
+// Sections follow the header at the given offsets: widgets, fonts, pngs, the
+// identifier index (same layout as Config.index) and the string table. Strings
+// are offsets into the table, 0 meaning none; colors are 0xRRGGBB and converted
+// to the framebuffer format on load.
+typedef struct _SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t widget_size;
+    // config.json the snapshot was compiled from
+    AssetStamp source;
+    uint32_t widget_count;
+    uint32_t font_count;
+    uint32_t png_count;
+    uint32_t index_size;
+    uint32_t widgets_offset;
+    uint32_t fonts_offset;
+    uint32_t pngs_offset;
+    uint32_t index_offset;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    // the history object, file 0 if there is none
+    uint32_t history_file;
+    uint32_t history_slots;
+    uint32_t history_samples;
+    // the export object, socket 0 if there is none
+    uint32_t export_socket;
+    uint32_t export_port;
+} SnapshotHeader;
+
+typedef struct _SnapshotWidget {
+    uint32_t type;
+    uint32_t identifier;
+    uint32_t source;
+    uint32_t filename;
+    uint32_t text;
+    uint32_t top;
+    uint32_t left;
+    uint32_t width;
+    uint32_t height;
+    int32_t min;
+    int32_t max;
+    uint32_t scale;
+    uint32_t precision;
+    uint32_t window;
+    uint32_t gap;
+    uint32_t stale;
+    uint32_t has_border;
+    uint32_t border_color;
+    uint32_t line_color;
+    // resolved references, SNAPSHOT_NONE if unset
+    uint32_t font;
+    uint32_t png;
+    uint32_t next_same;
+} SnapshotWidget;
+
+typedef struct _SnapshotFont {
+    uint32_t filename;
+    uint32_t size;
+} SnapshotFont;
+
+typedef struct _SnapshotPng {
+    uint32_t filename;
+} SnapshotPng;
+
+int compile_config(const char *filename, const char *output);
+int load_config_snapshot(const char *filename, const char *source, Config *config, const PixelFormat *fmt);
+
+#endif
@@ -11,20 +11,55 @@
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 #include <pthread.h>
 #include <zlib.h>
 
 #include "shared.h"
+#include "stats.h"
 
 #define PORT 8888
 #define MAGIC 0xdeadface
+// Version 2 packets: a flags word follows the length, then the fields the
+// flags ask for in flag order, then the payload. The crc covers everything
+// after the length.
+#define MAGIC_V2 0xdeadfade
+// the sender's host id, so one host keeps its identity across addresses
+#define PACKET_HOST_ID 0x1
+// a 32 bit sequence number, one more for every packet the sender sends
+#define PACKET_SEQ 0x2
+// the sender's wall clock ns when it sent the packet, which orders packets
+// that carry no sequence number
+#define PACKET_TIMESTAMP 0x4
+#define PACKET_FLAGS (PACKET_HOST_ID | PACKET_SEQ | PACKET_TIMESTAMP)
 #define MAX_PAYLOAD_LEN 65535
 #define HEADER_SIZE 8
+#define FLAGS_SIZE 4
+#define HOST_ID_SIZE 4
+#define SEQ_SIZE 4
+#define TIMESTAMP_SIZE 8
 #define CRC32_SIZE 4
-#define BUFFER_SIZE (MAX_PAYLOAD_LEN + HEADER_SIZE + CRC32_SIZE) // Magic (4) + Length (4) + Payload + CRC32 (4)
+#define FIELDS_SIZE (FLAGS_SIZE + HOST_ID_SIZE + SEQ_SIZE + TIMESTAMP_SIZE)
+#define BUFFER_SIZE (MAX_PAYLOAD_LEN + HEADER_SIZE + FIELDS_SIZE + CRC32_SIZE) // Magic (4) + Length (4) + Flags (4) + Fields (0-24) + Payload + CRC32 (4)
+
+// where things are in one received packet; the crc covers from HEADER_SIZE
+// up to the crc itself
+typedef struct _PacketHeader {
+    uint32_t flags;
+    uint32_t host_id;
+    uint32_t seq;
+    uint64_t timestamp;
+    size_t payload;
+    size_t payload_length;
+    size_t size;
+} PacketHeader;
 
 extern volatile bool running;
 
+uint32_t _crc32(const uint8_t *data, size_t length);
+void inflate_buffer(const uint8_t *input, size_t input_length, uint8_t *output, size_t *output_length);
+bool inflate_packet(z_stream *stream, const uint8_t *input, size_t input_length, uint8_t *output, size_t *output_length);
+size_t packet_parse(const uint8_t *packet, size_t length, PacketHeader *h);
 void *udp_listener(void *arg);
 
 #endif
\ No newline at end of file
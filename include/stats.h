@@ -0,0 +1,122 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define STATS_THREADS_MAX 32
+// stage times in power of two microsecond buckets, bucket i counting times
+// under 2^i us and the last one open ended
+#define STATS_BUCKETS 20
+#define STATS_REPORT_SECONDS 1
+#define STATS_TEXT_MAX 640
+
+typedef enum _StatsCounter {
+    // listener
+    STAT_PACKETS,
+    STAT_DROPPED,
+    STAT_CRC_ERRORS,
+    // sequence numbers that left the seen window without arriving
+    STAT_LOST,
+    STAT_DUPLICATES,
+    STAT_REORDERED,
+    STAT_CRC_NS,
+    STAT_INFLATE_NS,
+    // render loop
+    STAT_PARSED,
+    STAT_PARSE_NS,
+    // bytes of the parsed documents, the one copy of a payload after inflate
+    STAT_COPY_BYTES,
+    STAT_ROUTE_NS,
+    STAT_DRAW_NS,
+    STAT_SWAP_NS,
+    STAT_UPLOAD_BYTES,
+    STAT_UPLOAD_NS,
+    STAT_FRAMES,
+    STAT_FRAME_NS,
+    STAT_REDRAWS,
+    // packet latency
+    STAT_HANDOFF_NS,
+    STAT_DISPLAY_NS,
+    STAT_LATENCY_NS,
+    STAT_COUNTERS
+} StatsCounter;
+
+// stages timed into histograms, each also adding to its _NS counter
+typedef enum _StatsStage {
+    STAGE_CRC,
+    STAGE_INFLATE,
+    STAGE_PARSE,
+    STAGE_ROUTE,
+    STAGE_DRAW,
+    STAGE_SWAP,
+    STAGE_FRAME,
+    // handed off by the listener until picked up by the render loop
+    STAGE_HANDOFF,
+    // routed until the swap of the first frame showing it
+    STAGE_DISPLAY,
+    // received until shown
+    STAGE_LATENCY,
+    STATS_STAGES
+} StatsStage;
+
+// Counters of one thread. Only the owning thread writes them, with a relaxed
+// load and store instead of a locked add; readers sum every block. Blocks are
+// cache line aligned so two threads never write the same line.
+typedef struct _StatsBlock {
+    alignas(64) _Atomic uint64_t counters[STAT_COUNTERS];
+    _Atomic uint64_t hist[STATS_STAGES][STATS_BUCKETS];
+    const char *name;
+} StatsBlock;
+
+// sum of every block at one point in time
+typedef struct _StatsTotals {
+    uint64_t counters[STAT_COUNTERS];
+    uint64_t hist[STATS_STAGES][STATS_BUCKETS];
+} StatsTotals;
+
+// what the stats widget shows, rebuilt once a second from the change in the
+// totals since the last report
+typedef struct _StatsReport {
+    StatsTotals last;
+    double last_time;
+    char text[STATS_TEXT_MAX];
+} StatsReport;
+
+extern __thread StatsBlock *stats_local;
+// for threads that never registered, or came after every block was taken
+extern StatsBlock stats_shared;
+extern const char *const stats_stage_names[STATS_STAGES];
+extern const StatsCounter stats_stage_counters[STATS_STAGES];
+
+void stats_register(const char *name);
+void stats_time(StatsStage stage, uint64_t ns);
+void stats_collect(StatsTotals *totals);
+bool stats_report_due(const StatsReport *report, double now);
+void stats_report_update(StatsReport *report, double now, const char *slowest, uint64_t slowest_ns);
+
+static inline uint64_t stats_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void stats_add(StatsCounter counter, uint64_t n) {
+    StatsBlock *b = stats_local;
+
+    if (b) {
+        uint64_t v = atomic_load_explicit(&b->counters[counter], memory_order_relaxed);
+        atomic_store_explicit(&b->counters[counter], v + n, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&stats_shared.counters[counter], n, memory_order_relaxed);
+    }
+}
+
+#endif
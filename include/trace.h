@@ -0,0 +1,46 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "stats.h"
+
+#define TRACE_SECONDS 10
+#define TRACE_PACKETS_MAX 100000
+
+// Monotonic ns at each step of one packet, from the listener receiving it to
+// the fb_swap() of the first frame showing it; a step not reached is 0.
+typedef struct _PacketTrace {
+    uint64_t seq;
+    // listener
+    uint64_t received;
+    uint64_t checked;
+    uint64_t inflated;
+    uint64_t handed_off;
+    // render loop
+    uint64_t picked_up;
+    uint64_t parsed;
+    uint64_t routed;
+    uint64_t shown;
+} PacketTrace;
+
+// Packets traced over a bounded window, written as Chrome trace event JSON
+// (chrome://tracing, Perfetto) once the window ends or fills up.
+typedef struct _TraceLog {
+    char *filename;
+    uint64_t until;
+    PacketTrace *packets;
+    size_t count;
+    size_t capacity;
+} TraceLog;
+
+TraceLog *trace_open(const char *filename, double seconds);
+void trace_packet(TraceLog *log, const PacketTrace *t);
+void trace_close(TraceLog *log);
+
+#endif
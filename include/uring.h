@@ -0,0 +1,65 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "ingest.h"
+
+#define URING_ENTRIES 4
+#define URING_CQ_ENTRIES 256
+// provided buffers, a power of two; each holds the recvmsg header, the
+// sender address and one packet, and starts on a cache line
+#define URING_BUFFERS 64
+#define URING_BUFFER_SIZE ((sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + BUFFER_SIZE + 63) & ~(size_t)63)
+#define URING_GROUP 0
+// user_data telling the receive's completions from the cancel's
+#define URING_RECV 1
+#define URING_CANCEL 2
+
+// One io_uring with a single multishot recvmsg on the listener's socket.
+// Datagrams land in buffers the kernel takes from a registered ring, are
+// checked and inflated where they landed and the buffer goes back on the ring
+// once ingest_packet() is done with it. The rings are shared with the kernel:
+// only the listener moves the sq tail, cq head and buffer ring tail.
+typedef struct _Uring {
+    int fd;
+    int sockfd;
+    // sq and cq ring heads, one mapping since IORING_FEAT_SINGLE_MMAP
+    uint8_t *ring;
+    size_t ring_size;
+    _Atomic uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    _Atomic uint32_t *cq_head;
+    _Atomic uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+    // provided buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    uint16_t buf_tail;
+    uint8_t *buffers;
+    // asks for the sender's address only
+    struct msghdr msg;
+    // the multishot receive is queued and has not ended yet
+    bool armed;
+} Uring;
+
+int uring_receive(int sockfd, Ingest *in);
+
+#endif
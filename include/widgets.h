@@ -4,35 +4,68 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include <freetype2/ft2build.h>
 #include <freetype/freetype.h>
 
 #include "ft.h"
 #include "fb.h"
+#include "asset.h"
+#include "arena.h"
+#include "history.h"
 
-typedef struct Font {
-    FT_Face face;
-    char *filename;
-} Font;
+// seconds between samples that break the line of a window graph by default
+#define GRAPH_GAP_DEFAULT 5
+// seconds without a value before a graph or value is drawn as stale
+#define WIDGET_STALE_DEFAULT 10
 
 typedef struct Png {
     char *filename;
     size_t size;
     size_t width;
     size_t height;
-    uint16_t *data;
+    uint8_t *data;
+    uint8_t *alpha;
+    // set when data and alpha point into a mapped cache file
+    uint8_t *map;
+    size_t map_len;
+    AssetStamp stamp;
+    // set when carried over from the live config on reload
+    struct Png *reused_from;
 } Png;
 
-typedef struct LogEntry {
-    struct LogEntry *next;
-    struct LogEntry *prev;
-    double value;
-} LogEntry;
+typedef enum _WidgetType {
+    WIDGET_UNKNOWN,
+    WIDGET_GRAPH,
+    WIDGET_VALUE,
+    WIDGET_TEXT,
+    WIDGET_PNG,
+    WIDGET_STATS
+} WidgetType;
+
+// Fields the render loop and packet routing touch for every widget, kept as
+// a struct of arrays indexed like Config.widgets. dirty is set when a value
+// arrives and cleared once the frame showing it is drawn. draw_ns adds up the
+// time spent drawing each widget until the stats report takes it. updated is
+// the wall clock time of the newest value, 0 for none yet, and stale whether
+// the widget was last drawn as stale.
+typedef struct _WidgetHot {
+    uint8_t *kind;
+    uint8_t *dirty;
+    double *value;
+    uint64_t *draw_ns;
+    double *updated;
+    uint8_t *stale;
+} WidgetHot;
 
 typedef struct Widget {
     char *type;
+    WidgetType kind;
     char *identifier;
+    // only values from this sender, see IngestSource; NULL for any
+    char *source;
     // location
     size_t top;
     size_t left;
@@ -43,26 +76,53 @@ typedef struct Widget {
     int max;
     size_t scale;
     size_t precision;
+    // seconds a graph spans, 0 for one sample every scale pixels
+    double window;
+    // seconds between samples after which the line is broken, 0 for the
+    // default: GRAPH_GAP_DEFAULT with a window, never without
+    double gap;
+    // seconds without a value after which it is drawn as stale, 0 for never
+    double stale;
     // colors
     bool has_border;
-    uint16_t border_color;
-    uint16_t line_color;
+    uint32_t border_color;
+    uint32_t line_color;
     // linked to file
     char *filename;
     // text
     char *text;
     size_t size;
     // internal
-    FT_Face face;
+    Font *font;
     Png *png;
-    LogEntry *head;
-    LogEntry *tail;
-    double value;
-    size_t log_count;
+    History history;
+    // persistent history of the identifier, if there is a history file
+    struct _HistorySlot *slot;
+    // next widget with the same identifier
+    struct Widget *next_same;
 } Widget;
 
-void widget_free(Widget *w);
-void widget_log_push(Widget *w, double value);
-void widget_draw(Widget *w, FrameBuffer *fb);
+WidgetType widget_type(const char *type);
+int widget_history_init(Widget *w, Arena *arena);
+void widget_log_push(Widget *w, double value, double time);
+void widget_adopt_history(Widget *w, Widget *old);
+void widget_draw_static(Widget *w, FrameBuffer *fb);
+bool widget_scrolled(const Widget *w, double from, double to);
+void widget_draw(Widget *w, double value, double now, bool stale, FrameBuffer *fb);
+void widget_draw_lines(Widget *w, const char *text, FrameBuffer *fb);
+
+static inline bool widget_shows_source(const Widget *w, const char *source) {
+    return !w->source || (source && strcmp(w->source, source) == 0);
+}
+
+static inline bool widget_same_source(const Widget *a, const Widget *b) {
+    return a->source == b->source || (a->source && b->source && strcmp(a->source, b->source) == 0);
+}
+
+// whether the newest value, received at updated, is too old to trust; a
+// widget that never had one has nothing to go stale
+static inline bool widget_stale(const Widget *w, double updated, double now) {
+    return w->stale > 0 && updated > 0 && now - updated > w->stale;
+}
 
 #endif
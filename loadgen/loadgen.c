@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <zlib.h>
+
+#include "sock.h"
+
+// distinct packets each sender cycles through, so sending costs no deflate
+#define LOADGEN_PACKETS 64
+#define LOADGEN_SENDERS_MAX 64
+#define LOADGEN_RESPONSE_MAX (1 << 20)
+
+volatile bool running = true;
+
+// rtop-loadgen [--ids N] [--rate N] [--size N] [--level N] [--corrupt F]
+//              [--senders N] [--seconds N] [--port N] [--prefix S] [--host-id N]
+//              [--seq] [--loss F] [--duplicate F] [--reorder F] [--restart N]
+//              [--pause S] [--stats ADDR]
+typedef struct _LoadgenOptions {
+    size_t ids;
+    // packets per second over every sender, 0 as fast as they can
+    double rate;
+    // pad each payload to at least this many bytes of json
+    size_t size;
+    int level;
+    // fraction of packets sent with a bad crc
+    double corrupt;
+    size_t senders;
+    double seconds;
+    uint16_t port;
+    const char *prefix;
+    // send version 2 packets, sender i with host id host_id + i
+    bool has_host_id;
+    uint32_t host_id;
+    // send version 2 packets with a sequence number and timestamp
+    bool seq;
+    // fractions of sequence numbers skipped, of packets sent twice and of
+    // packets swapped with the one after them
+    double loss;
+    double duplicate;
+    double reorder;
+    // start the sequence over at 0 every restart packets, as a restarted
+    // sender would, after pause seconds of silence
+    size_t restart;
+    double pause;
+    // the receiver's stats exporter, a socket path or a loopback port
+    const char *stats;
+} LoadgenOptions;
+
+typedef struct _Sender {
+    pthread_t thread;
+    const LoadgenOptions *options;
+    unsigned int seed;
+    uint32_t host_id;
+    uint8_t *packets[LOADGEN_PACKETS];
+    size_t lengths[LOADGEN_PACKETS];
+    // where the sequence number goes, 0 without one
+    size_t seq_offset;
+    uint32_t seq;
+    size_t since_restart;
+    // results
+    uint64_t sent;
+    uint64_t corrupted;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t restarts;
+} Sender;
+
+// what the receiver counted, from its exporter
+typedef struct _ReceiverTotals {
+    double packets;
+    double dropped;
+    double crc_errors;
+    double lost;
+    double duplicates;
+    double reordered;
+    double parsed;
+} ReceiverTotals;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_for(double seconds) {
+    struct timespec ts = {.tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+}
+
+static void handle_sigint(int sig) {
+    (void)sig;
+    running = false;
+}
+
+// {"<prefix>0": {"Value": ...}, ...} padded with a "Text" nothing routes
+static char *write_payload(const LoadgenOptions *o, unsigned int *seed, size_t *length) {
+    size_t capacity = o->ids * (strlen(o->prefix) + 64) + o->size + 64;
+    size_t len = 0;
+
+    char *payload = malloc(capacity);
+    if (payload == NULL) {
+        return NULL;
+    }
+
+    len += snprintf(payload + len, capacity - len, "{");
+    for (size_t i = 0; i < o->ids; i++) {
+        len += snprintf(payload + len, capacity - len, "%s\"%s%zu\": {\"Value\": %.3f}", i ? ", " : "", o->prefix, i,
+                        (rand_r(seed) % 100000) / 1000.0);
+    }
+
+    size_t pad = len + 20 < o->size ? o->size - len - 20 : 0;
+    if (pad) {
+        len += snprintf(payload + len, capacity - len, "%s\"pad\": {\"Text\": \"", o->ids ? ", " : "");
+        memset(payload + len, 'x', pad);
+        len += pad;
+        len += snprintf(payload + len, capacity - len, "\"}");
+    }
+    len += snprintf(payload + len, capacity - len, "}");
+
+    *length = len;
+    return payload;
+}
+
+// magic, length, raw deflate of the payload and its crc, as the sender does;
+// version 2 with a host id and/or a sequence number if the options ask for
+// them, the sequence number and timestamp being filled in on each send
+static uint8_t *write_packet(Sender *s, const char *payload, size_t length, size_t *packet_length) {
+    z_stream stream = {0};
+    size_t bound = compressBound(length);
+    size_t offset = HEADER_SIZE;
+    int level = s->options->level;
+
+    uint8_t *packet = calloc(1, HEADER_SIZE + FIELDS_SIZE + bound + CRC32_SIZE);
+    if (packet == NULL || deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(packet);
+        return NULL;
+    }
+
+    uint32_t magic = MAGIC;
+    if (s->options->has_host_id || s->options->seq) {
+        uint32_t flags = (s->options->has_host_id ? PACKET_HOST_ID : 0) | (s->options->seq ? PACKET_SEQ | PACKET_TIMESTAMP : 0);
+        magic = MAGIC_V2;
+        memcpy(packet + offset, &flags, sizeof(flags));
+        offset += FLAGS_SIZE;
+    }
+    if (s->options->has_host_id) {
+        memcpy(packet + offset, &s->host_id, sizeof(s->host_id));
+        offset += HOST_ID_SIZE;
+    }
+    if (s->options->seq) {
+        s->seq_offset = offset;
+        offset += SEQ_SIZE + TIMESTAMP_SIZE;
+    }
+
+    stream.next_in = (Bytef *)payload;
+    stream.avail_in = length;
+    stream.next_out = packet + offset;
+    stream.avail_out = bound;
+    int ret = deflate(&stream, Z_FINISH);
+    uint32_t compressed = stream.total_out;
+    deflateEnd(&stream);
+
+    if (ret != Z_STREAM_END || compressed > MAX_PAYLOAD_LEN) {
+        fprintf(stderr, "Error: Payload of %zu bytes does not fit a packet\n", length);
+        free(packet);
+        return NULL;
+    }
+
+    // the crc covers everything after the length
+    uint32_t crc = _crc32(packet + HEADER_SIZE, offset - HEADER_SIZE + compressed);
+    memcpy(packet, &magic, sizeof(magic));
+    memcpy(packet + CRC32_SIZE, &compressed, sizeof(compressed));
+    memcpy(packet + offset + compressed, &crc, sizeof(crc));
+
+    *packet_length = offset + compressed + CRC32_SIZE;
+    return packet;
+}
+
+// number a packet for its send and redo the crc over the new fields
+static void stamp_packet(const Sender *s, uint8_t *packet, size_t length, uint32_t seq) {
+    struct timespec ts;
+
+    if (!s->seq_offset) {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    memcpy(packet + s->seq_offset, &seq, sizeof(seq));
+    memcpy(packet + s->seq_offset + SEQ_SIZE, &timestamp, sizeof(timestamp));
+
+    uint32_t crc = _crc32(packet + HEADER_SIZE, length - HEADER_SIZE - CRC32_SIZE);
+    memcpy(packet + length - CRC32_SIZE, &crc, sizeof(crc));
+}
+
+// whether an event with the given probability happens this time
+static bool chance(unsigned int *seed, double fraction) {
+    return fraction > 0 && rand_r(seed) < fraction * ((double)RAND_MAX + 1);
+}
+
+// stamp and send one pool packet, corrupting it if the dice say so; false
+// on a send error
+static bool send_packet(int fd, Sender *s, size_t i, uint32_t seq) {
+    uint8_t *packet = s->packets[i % LOADGEN_PACKETS];
+    size_t length = s->lengths[i % LOADGEN_PACKETS];
+    bool corrupt = chance(&s->seed, s->options->corrupt);
+
+    stamp_packet(s, packet, length, seq);
+
+    // flip a payload bit for the one send
+    if (corrupt) {
+        packet[length - CRC32_SIZE - 1] ^= 1;
+    }
+    ssize_t n = send(fd, packet, length, 0);
+    if (corrupt) {
+        packet[length - CRC32_SIZE - 1] ^= 1;
+    }
+
+    if (n < 0) {
+        s->errors++;
+        return false;
+    }
+    s->sent++;
+    s->corrupted += corrupt;
+    s->bytes += length;
+    return true;
+}
+
+static bool sender_init(Sender *s) {
+    for (size_t i = 0; i < LOADGEN_PACKETS; i++) {
+        size_t length = 0;
+        char *payload = write_payload(s->options, &s->seed, &length);
+        if (payload == NULL) {
+            return false;
+        }
+        s->packets[i] = write_packet(s, payload, length, &s->lengths[i]);
+        free(payload);
+        if (s->packets[i] == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// one socket sending its share of the rate, on a fixed schedule so a late
+// packet does not push back the ones after it
+static void *sender_run(void *arg) {
+    Sender *s = arg;
+    const LoadgenOptions *o = s->options;
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    double interval = o->rate > 0 ? o->senders / o->rate : 0;
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(o->port);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Error: Could not create sender socket");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    double start = now(), next = start;
+
+    while (running && now() - start < o->seconds) {
+        if (o->restart && s->since_restart == o->restart) {
+            if (o->pause > 0) {
+                sleep_for(o->pause);
+                next = now();
+            }
+            s->seq = 0;
+            s->since_restart = 0;
+            s->restarts++;
+        }
+        s->since_restart++;
+
+        if (interval > 0) {
+            double wait = next - now();
+            if (wait > 0) {
+                sleep_for(wait);
+            }
+            next += interval;
+        }
+
+        // a lost packet only leaves a hole in the sequence
+        if (chance(&s->seed, o->loss)) {
+            s->seq++;
+            s->lost++;
+            continue;
+        }
+
+        // the next packet overtakes this one, which then arrives late
+        if (chance(&s->seed, o->reorder)) {
+            if (send_packet(fd, s, s->seq + 1, s->seq + 1) && send_packet(fd, s, s->seq, s->seq)) {
+                s->reordered++;
+            }
+            s->seq += 2;
+            continue;
+        }
+
+        if (send_packet(fd, s, s->seq, s->seq) && chance(&s->seed, o->duplicate) && send_packet(fd, s, s->seq, s->seq)) {
+            s->duplicated++;
+        }
+        s->seq++;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static int stats_connect(const char *stats) {
+    int fd;
+
+    if (strchr(stats, '/')) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(stats) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, stats);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+    } else {
+        struct sockaddr_in addr = {.sin_family = AF_INET};
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(atoi(stats));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return -1;
+}
+
+static double stats_value(const char *text, const char *name) {
+    size_t len = strlen(name);
+
+    for (const char *line = text; line; line = strchr(line, '\n')) {
+        line += *line == '\n';
+        if (strncmp(line, name, len) == 0 && line[len] == ' ') {
+            return strtod(line + len + 1, NULL);
+        }
+    }
+    return 0;
+}
+
+// scrape the receiver's counters
+static int stats_scrape(const char *stats, ReceiverTotals *totals) {
+    const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    size_t len = 0;
+
+    int fd = stats_connect(stats);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not connect to rtop stats on %s\n", stats);
+        return -1;
+    }
+
+    char *response = malloc(LOADGEN_RESPONSE_MAX);
+    if (response == NULL || send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) < 0) {
+        free(response);
+        close(fd);
+        return -1;
+    }
+
+    ssize_t n;
+    while (len < LOADGEN_RESPONSE_MAX - 1 && (n = recv(fd, response + len, LOADGEN_RESPONSE_MAX - 1 - len, 0)) > 0) {
+        len += n;
+    }
+    response[len] = '\0';
+    close(fd);
+
+    totals->packets = stats_value(response, "rtop_packets_total");
+    totals->dropped = stats_value(response, "rtop_dropped_total");
+    totals->crc_errors = stats_value(response, "rtop_crc_errors_total");
+    totals->lost = stats_value(response, "rtop_lost_total");
+    totals->duplicates = stats_value(response, "rtop_duplicates_total");
+    totals->reordered = stats_value(response, "rtop_reordered_total");
+    totals->parsed = stats_value(response, "rtop_parsed_total");
+
+    free(response);
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--ids N] [--rate PACKETS/S] [--size BYTES] [--level 0-9] [--corrupt FRACTION]\n"
+                    "       [--senders N] [--seconds N] [--port N] [--prefix IDENTIFIER] [--host-id N]\n"
+                    "       [--seq] [--loss FRACTION] [--duplicate FRACTION] [--reorder FRACTION]\n"
+                    "       [--restart PACKETS] [--pause SECONDS] [--stats SOCKET|PORT]\n", name);
+}
+
+int main(int argc, char **argv) {
+    LoadgenOptions o = {
+        .ids = 64,
+        .rate = 1000,
+        .level = Z_DEFAULT_COMPRESSION,
+        .senders = 1,
+        .seconds = 10,
+        .port = PORT,
+        .prefix = "/loadgen/",
+    };
+    ReceiverTotals before = {0}, after = {0};
+    Sender *senders = NULL;
+    int ret = EXIT_FAILURE;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--seq") == 0) {
+            o.seq = true;
+            continue;
+        } else if (value == NULL) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "--ids") == 0) {
+            o.ids = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            o.rate = atof(value);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            o.size = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--level") == 0) {
+            o.level = atoi(value);
+        } else if (strcmp(argv[i], "--corrupt") == 0) {
+            o.corrupt = atof(value);
+        } else if (strcmp(argv[i], "--senders") == 0) {
+            o.senders = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            o.seconds = atof(value);
+        } else if (strcmp(argv[i], "--port") == 0) {
+            o.port = atoi(value);
+        } else if (strcmp(argv[i], "--prefix") == 0) {
+            o.prefix = value;
+        } else if (strcmp(argv[i], "--host-id") == 0) {
+            o.has_host_id = true;
+            o.host_id = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--loss") == 0) {
+            o.loss = atof(value);
+        } else if (strcmp(argv[i], "--duplicate") == 0) {
+            o.duplicate = atof(value);
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            o.reorder = atof(value);
+        } else if (strcmp(argv[i], "--restart") == 0) {
+            o.restart = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--pause") == 0) {
+            o.pause = atof(value);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            o.stats = value;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+
+    if (!o.senders || o.senders > LOADGEN_SENDERS_MAX || o.level < Z_DEFAULT_COMPRESSION || o.level > 9 ||
+        o.corrupt < 0 || o.corrupt > 1 || o.rate < 0 || o.seconds <= 0 || o.loss < 0 || o.duplicate < 0 ||
+        o.reorder < 0 || o.loss + o.duplicate + o.reorder > 1 || o.pause < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, handle_sigint);
+
+    senders = calloc(o.senders, sizeof(Sender));
+    if (senders == NULL) {
+        perror("Error: Memory allocation failed");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < o.senders; i++) {
+        senders[i].options = &o;
+        senders[i].seed = i + 1;
+        senders[i].host_id = o.host_id + i;
+        if (!sender_init(&senders[i])) {
+            fprintf(stderr, "Error: Could not build packets\n");
+            goto cleanup;
+        }
+    }
+
+    if (o.stats && stats_scrape(o.stats, &before) != 0) {
+        goto cleanup;
+    }
+
+    printf("Sending %zu identifiers in %zu byte packets from %zu sockets to 127.0.0.1:%u for %.0f s, %s\n",
+           o.ids, senders[0].lengths[0], o.senders, o.port, o.seconds, o.rate > 0 ? "paced" : "unpaced");
+
+    double start = now();
+    size_t started = 0;
+    for (; started < o.senders; started++) {
+        if (pthread_create(&senders[started].thread, NULL, sender_run, &senders[started]) != 0) {
+            perror("Error: Could not create sender thread");
+            running = false;
+            break;
+        }
+    }
+
+    uint64_t sent = 0, corrupted = 0, bytes = 0, errors = 0, lost = 0, duplicated = 0, reordered = 0, restarts = 0;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(senders[i].thread, NULL);
+        sent += senders[i].sent;
+        corrupted += senders[i].corrupted;
+        bytes += senders[i].bytes;
+        errors += senders[i].errors;
+        lost += senders[i].lost;
+        duplicated += senders[i].duplicated;
+        reordered += senders[i].reordered;
+        restarts += senders[i].restarts;
+    }
+    double elapsed = now() - start;
+
+    printf("Sent %" PRIu64 " packets in %.3f s, %.0f packets/s, %.1f MB/s, %" PRIu64 " corrupted, %" PRIu64 " send errors\n", sent, elapsed,
+           sent / elapsed, bytes / elapsed / 1e6, corrupted, errors);
+    if (o.loss > 0 || o.duplicate > 0 || o.reorder > 0) {
+        printf("Skipped %" PRIu64 " sequence numbers, sent %" PRIu64 " duplicates, swapped %" PRIu64 " pairs\n", lost, duplicated, reordered);
+    }
+    if (restarts) {
+        printf("Started the sequence over %" PRIu64 " times\n", restarts);
+    }
+
+    if (o.stats) {
+        // let the receiver drain its socket before counting
+        sleep(1);
+        if (stats_scrape(o.stats, &after) != 0) {
+            goto cleanup;
+        }
+
+        double valid = after.packets - before.packets;
+        double parsed = after.parsed - before.parsed;
+        uint64_t intact = sent - corrupted;
+
+        printf("Receiver: %.0f valid (%.1f%% of %" PRIu64 " intact), %.0f crc errors, %.0f dropped, %.0f parsed (%.1f%%), %.0f parsed/s\n",
+               valid, intact ? valid / intact * 100 : 0, intact, after.crc_errors - before.crc_errors,
+               after.dropped - before.dropped, parsed, intact ? parsed / intact * 100 : 0, parsed / elapsed);
+        printf("Receiver: %.0f lost, %.0f duplicates, %.0f reordered\n", after.lost - before.lost,
+               after.duplicates - before.duplicates, after.reordered - before.reordered);
+    }
+
+    ret = EXIT_SUCCESS;
+
+    cleanup:
+    for (size_t i = 0; i < o.senders; i++) {
+        for (size_t j = 0; j < LOADGEN_PACKETS; j++) {
+            free(senders[i].packets[j]);
+        }
+    }
+    free(senders);
+    return ret;
+}
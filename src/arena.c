@@ -0,0 +1,50 @@
+#include "arena.h"
+
+void *arena_alloc(Arena *arena, size_t size) {
+    ArenaBlock *block = arena->blocks;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!block || block->used + size > block->size) {
+        size_t block_size = arena->block_size ? arena->block_size : ARENA_BLOCK_SIZE;
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        // data[] starts 16 byte aligned after the three header words
+        block = malloc(sizeof(ArenaBlock) + ARENA_ALIGN + block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = (ARENA_ALIGN - ((uintptr_t)block->data & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+        block->size += block->used;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->block_size = 0;
+        arena->allocated += block_size;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+void arena_free(Arena *arena) {
+    while (arena->blocks) {
+        ArenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->allocated = 0;
+}
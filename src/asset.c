@@ -0,0 +1,20 @@
+#include "asset.h"
+
+bool asset_stamp(const char *filename, AssetStamp *stamp) {
+    struct stat st;
+
+    if (stat(filename, &st) != 0) {
+        return false;
+    }
+
+    stamp->mtime = st.st_mtim;
+    stamp->size = st.st_size;
+    return true;
+}
+
+bool asset_unchanged(const char *filename, const AssetStamp *stamp) {
+    AssetStamp current;
+
+    return asset_stamp(filename, &current) && current.size == stamp->size &&
+           current.mtime.tv_sec == stamp->mtime.tv_sec && current.mtime.tv_nsec == stamp->mtime.tv_nsec;
+}
@@ -0,0 +1,113 @@
+#include "capture.h"
+
+// open a capture to replay, or to record into, starting it if the file is
+// missing or empty
+Capture *capture_open(const char *filename, bool writing) {
+    CaptureHeader header = {0};
+
+    Capture *c = calloc(1, sizeof(Capture));
+    if (c == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    c->fp = fopen(filename, writing ? "a+b" : "rb");
+    if (c->fp == NULL) {
+        fprintf(stderr, "Error: Could not open capture %s\n", filename);
+        goto cleanup;
+    }
+
+    size_t n = fread(&header, 1, sizeof(header), c->fp);
+    if (writing && n == 0) {
+        header.magic = CAPTURE_MAGIC;
+        header.version = CAPTURE_VERSION;
+        if (fwrite(&header, sizeof(header), 1, c->fp) != 1) {
+            fprintf(stderr, "Error: Could not write capture %s\n", filename);
+            goto cleanup;
+        }
+    } else if (n != sizeof(header) || header.magic != CAPTURE_MAGIC) {
+        fprintf(stderr, "Error: %s is not a capture\n", filename);
+        goto cleanup;
+    } else if (header.version != CAPTURE_VERSION) {
+        fprintf(stderr, "Error: Capture %s is version %u, expected %u\n", filename, header.version, CAPTURE_VERSION);
+        goto cleanup;
+    }
+
+    c->filename = strdup(filename);
+    c->writing = writing;
+    printf("%s packets %s %s\n", writing ? "Recording" : "Replaying", writing ? "to" : "from", filename);
+    return c;
+
+    cleanup:
+    if (c->fp) {
+        fclose(c->fp);
+    }
+    free(c);
+    return NULL;
+}
+
+// listener: buffered, so recording costs a copy until the buffer fills
+int capture_write(Capture *c, const uint8_t *packet, size_t length, uint64_t time_ns, const struct sockaddr_in *from) {
+    CaptureRecord record = {
+        .time_ns = time_ns,
+        .length = length,
+        .addr = from->sin_addr.s_addr,
+        .port = from->sin_port
+    };
+
+    // every listener records to the same capture, a record is written whole
+    flockfile(c->fp);
+    if (c->failed) {
+        funlockfile(c->fp);
+        return -1;
+    }
+
+    if (fwrite(&record, sizeof(record), 1, c->fp) != 1 || fwrite(packet, 1, length, c->fp) != length) {
+        fprintf(stderr, "Error: Could not write capture %s, recording stopped\n", c->filename);
+        c->failed = true;
+        funlockfile(c->fp);
+        return -1;
+    }
+    c->packets++;
+    funlockfile(c->fp);
+    return 0;
+}
+
+// the next packet, 1 if there is one, 0 at the end and -1 if the capture is
+// truncated or a packet does not fit
+int capture_read(Capture *c, uint8_t *packet, size_t capacity, size_t *length, uint64_t *time_ns, struct sockaddr_in *from) {
+    CaptureRecord record;
+
+    size_t n = fread(&record, 1, sizeof(record), c->fp);
+    if (n == 0 && feof(c->fp)) {
+        return 0;
+    }
+    if (n != sizeof(record) || record.length > capacity || fread(packet, 1, record.length, c->fp) != record.length) {
+        fprintf(stderr, "Error: Capture %s is damaged after %zu packets\n", c->filename, c->packets);
+        return -1;
+    }
+
+    *length = record.length;
+    *time_ns = record.time_ns;
+    memset(from, 0, sizeof(struct sockaddr_in));
+    from->sin_family = AF_INET;
+    from->sin_addr.s_addr = record.addr;
+    from->sin_port = record.port;
+    c->packets++;
+    return 1;
+}
+
+void capture_close(Capture *c) {
+    if (c == NULL) {
+        return;
+    }
+
+    if (fclose(c->fp) != 0) {
+        fprintf(stderr, "Error: Could not write capture %s\n", c->filename);
+    } else if (c->writing) {
+        printf("Recorded %zu packets to %s\n", c->packets, c->filename);
+    }
+
+    free(c->filename);
+    free(c);
+}
@@ -1,6 +1,10 @@
 #include "config.h"
+#include "histstore.h"
 
-uint16_t hex_to_rgb565(const char *hex_string) {
+size_t config_asset_threads = 0;
+bool config_asset_report = true;
+
+uint32_t hex_to_color(const PixelFormat *fmt, const char *hex_string) {
     if (hex_string == NULL) {
         return false;
     }
@@ -20,81 +24,167 @@ uint16_t hex_to_rgb565(const char *hex_string) {
         return false;
     }
 
-    return rgb_to_rgb565(r, g, b);
+    return fmt->rgb(r, g, b);
 }
 
 void unload_config(Config *config) {
-    // widgets
-    if (config->widgets && config->widget_count) {
-        for (size_t i = 0; i < config->widget_count; i++) {
-            widget_free(&config->widgets[i]);
+    // fonts
+    for (size_t i = 0; i < config->font_count; i++) {
+        font_release(&config->fonts[i]);
+    }
+
+    // pngs
+    for (size_t i = 0; i < config->png_count; i++) {
+        if (config->pngs[i].reused_from) {
+            continue;
         }
+
+        png_release(&config->pngs[i]);
     }
 
-    if(config->widgets) {
-        free(config->widgets);
+    // the widget, font and png arrays, their strings, the hot widget fields
+    // and the identifier index all live in the arena or the snapshot mapping
+    if (config->map) {
+        munmap(config->map, config->map_len);
     }
 
-    // fonts
-    if (config->fonts && config->font_count) {
-        for (size_t i = 0; i < config->font_count; i++) {
-            if (config->fonts[i].filename) {
-              free(config->fonts[i].filename);
-            }
+    arena_free(&config->arena);
+}
+
+// graph history rings, sized by each graph's width, scale and window
+int config_init_history(Config *config) {
+    for (size_t i = 0; i < config->widget_count; i++) {
+        if (widget_history_init(&config->widgets[i], &config->arena) != 0) {
+            perror("Error: Memory allocation failed");
+            return -1;
         }
     }
 
-    if (config->fonts) {
-        free(config->fonts);
+    return 0;
+}
+
+// allocate the widget, font and png arrays once their counts are known
+int config_reserve(Config *config, size_t widgets, size_t fonts, size_t pngs) {
+    config->widgets = arena_alloc(&config->arena, sizeof(Widget) * (widgets + 1));
+    config->fonts = arena_alloc(&config->arena, sizeof(Font) * (fonts + 1));
+    config->pngs = arena_alloc(&config->arena, sizeof(Png) * (pngs + 1));
+    if (!config->widgets || !config->fonts || !config->pngs) {
+        perror("Error: Memory allocation failed");
+        return -1;
     }
 
-    // pngs
-    if (config->pngs && config->png_count) {
-        for (size_t i = 0; i < config->png_count; i++) {
-            if (config->pngs[i].filename) {
-              free(config->pngs[i].filename);
-            }
+    config->widget_capacity = widgets;
+    config->font_capacity = fonts;
+    config->png_capacity = pngs;
+    return 0;
+}
 
-            if (config->pngs[i].data) {
-              free(config->pngs[i].data);
-            }
-        }
+// fill the hot per-frame fields once every widget is in place
+int config_build_hot(Config *config) {
+    size_t count = config->widget_count;
+
+    config->hot.kind = arena_alloc(&config->arena, count + 1);
+    config->hot.dirty = arena_alloc(&config->arena, count + 1);
+    config->hot.value = arena_alloc(&config->arena, sizeof(double) * (count + 1));
+    config->hot.draw_ns = arena_alloc(&config->arena, sizeof(uint64_t) * (count + 1));
+    config->hot.updated = arena_alloc(&config->arena, sizeof(double) * (count + 1));
+    config->hot.stale = arena_alloc(&config->arena, count + 1);
+    if (!config->hot.kind || !config->hot.dirty || !config->hot.value || !config->hot.draw_ns ||
+        !config->hot.updated || !config->hot.stale) {
+        perror("Error: Memory allocation failed");
+        return -1;
     }
 
-    if (config->pngs) {
-        free(config->pngs);
+    for (size_t i = 0; i < count; i++) {
+        config->hot.kind[i] = config->widgets[i].kind;
     }
 
-    if (config->ft) {
-        FT_Done_FreeType(config->ft);
+    return 0;
+}
+
+uint32_t config_hash(const char *s) {
+    uint32_t h = 0x811c9dc5;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 0x01000193;
     }
+    return h;
 }
 
-int add_png(Config *config, struct json_object_s *png_obj) {
-    int ret = -1;
+// open addressed index of widget identifiers, each slot holding the first
+// widget (index + 1) with that identifier; the others are chained via next_same
+int config_build_index(Config *config) {
+    size_t size = 1;
+    while (size < config->widget_count * 2) {
+        size <<= 1;
+    }
 
-    int width, height, color_type, bit_depth;
-    struct json_object_element_s *elem = png_obj->start;
-    const char* filename;
-    FILE *fp = NULL;
-    uint8_t *image_data = NULL;
-    png_bytep *row_pointers = NULL;
-    png_structp png_ptr = NULL;
+    uint32_t *index = arena_alloc(&config->arena, size * sizeof(uint32_t));
+    if (index == NULL) {
+        perror("Error: Memory allocation failed");
+        return -1;
+    }
 
-    // walk through font object properties
-    while (elem != NULL) {
-        if (strcmp(elem->name->string, "filename") == 0) {
-            struct json_string_s *value = json_value_as_string(elem->value);
-            filename = value->string;
+    for (size_t i = 0; i < config->widget_count; i++) {
+        Widget *w = &config->widgets[i];
+        w->next_same = NULL;
+        if (!w->identifier) {
+            continue;
         }
-        elem = elem->next;
+
+        size_t slot = config_hash(w->identifier) & (size - 1);
+        while (index[slot] && strcmp(config->widgets[index[slot] - 1].identifier, w->identifier) != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+
+        if (!index[slot]) {
+            index[slot] = i + 1;
+            continue;
+        }
+
+        Widget *tail = &config->widgets[index[slot] - 1];
+        while (tail->next_same) {
+            tail = tail->next_same;
+        }
+        tail->next_same = w;
     }
 
-    if (!filename) {
-        perror("Error: Could not load png file");
-        goto cleanup;
+    config->index = index;
+    config->index_mask = size - 1;
+    return 0;
+}
+
+// first widget with the given identifier, the rest follow through next_same
+Widget *config_find_widget(const Config *config, const char *identifier) {
+    if (!config->index) {
+        return NULL;
     }
 
+    size_t slot = config_hash(identifier) & config->index_mask;
+    while (config->index[slot]) {
+        Widget *w = &config->widgets[config->index[slot] - 1];
+        if (strcmp(w->identifier, identifier) == 0) {
+            return w;
+        }
+        slot = (slot + 1) & config->index_mask;
+    }
+
+    return NULL;
+}
+
+// decode a png with libpng into fmt pixels, plus a premultiplied alpha plane
+// if any pixel is translucent
+int decode_png(const char *filename, const PixelFormat *fmt, Png *png) {
+    volatile int ret = -1;
+
+    int width, height, color_type, bit_depth;
+    FILE * volatile fp = NULL;
+    uint8_t * volatile image_data = NULL;
+    uint8_t * volatile pixel_data = NULL;
+    uint8_t * volatile alpha_data = NULL;
+    png_bytep * volatile row_pointers = NULL;
+    png_structp png_ptr = NULL;
+    png_infop info_ptr = NULL;
+
     fp = fopen(filename, "rb");
     if (!fp) {
         fprintf(stderr, "Error: File %s could not be opened for reading\n", filename);
@@ -120,7 +210,7 @@ int add_png(Config *config, struct json_object_s *png_obj) {
         goto cleanup;
     }
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
+    info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
         fprintf(stderr, "Error: png_create_info_struct failed\n");
         goto cleanup;
@@ -156,6 +246,8 @@ int add_png(Config *config, struct json_object_s *png_obj) {
         png_set_palette_to_rgb(png_ptr);
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
         png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png_ptr);
     if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
         png_set_tRNS_to_alpha(png_ptr);
 
@@ -193,54 +285,55 @@ int add_png(Config *config, struct json_object_s *png_obj) {
 
     png_read_image(png_ptr, row_pointers);
 
-    uint16_t *rgb565_image_data = malloc(width * height * sizeof(uint16_t));
-    if (!rgb565_image_data) {
+    pixel_data = malloc(width * height * fmt->Bpp);
+    if (!pixel_data) {
         fprintf(stderr, "Error: Memory allocation failed\n");
         goto cleanup;
     }
 
-    int bytes_per_pixel = (color_type == PNG_COLOR_TYPE_RGBA) ? 4 : 3;
+    int bytes_per_pixel = png_get_channels(png_ptr, info_ptr);
+    bool translucent = false;
 
     for (int i = 0; i < width * height; i++) {
         uint8_t r = image_data[i * bytes_per_pixel];
         uint8_t g = image_data[i * bytes_per_pixel + 1];
         uint8_t b = image_data[i * bytes_per_pixel + 2];
 
-        // Convert to RGB565 and store
-        rgb565_image_data[i] = rgb_to_rgb565(r, g, b);
-    }
+        if (bytes_per_pixel == 4 && image_data[i * bytes_per_pixel + 3] != 0xff) {
+            translucent = true;
+        }
 
-    free(image_data);
+        // Convert to the framebuffer format and store
+        fmt->put(pixel_data + i * fmt->Bpp, fmt->rgb(r, g, b));
+    }
 
-    // add png
-    if (config->pngs == NULL) {
-        config->png_count = 0;
-        config->pngs = malloc(sizeof(Png));
-        if (config->pngs == NULL) {
-            perror("Error: Memory allocation failed");
+    // keep an alpha plane and premultiply colors only when the image needs blending
+    if (translucent) {
+        alpha_data = malloc(width * height);
+        if (!alpha_data) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
             goto cleanup;
         }
-    } else {
-        Png *new_ptr = realloc(config->pngs, sizeof(Png) * (config->png_count + 1));
-        if (new_ptr == NULL) {
-            perror("Error: Memory allocation failed");
-            goto cleanup;
+
+        for (int i = 0; i < width * height; i++) {
+            uint8_t a = image_data[i * bytes_per_pixel + 3];
+            uint8_t r = image_data[i * bytes_per_pixel] * a / 255;
+            uint8_t g = image_data[i * bytes_per_pixel + 1] * a / 255;
+            uint8_t b = image_data[i * bytes_per_pixel + 2] * a / 255;
+
+            alpha_data[i] = a;
+            fmt->put(pixel_data + i * fmt->Bpp, fmt->rgb(r, g, b));
         }
-        config->pngs = new_ptr;
     }
 
-    config->pngs[config->png_count].filename = calloc(1, strlen(filename) + 1);
-    if (config->pngs[config->png_count].filename == NULL) {
-        perror("Error: Memory allocation failed");
-        goto cleanup;
-    }
-    memcpy(config->pngs[config->png_count].filename, filename, strlen(filename));
+    free(image_data);
+    image_data = NULL;
 
-    config->pngs[config->png_count].data = rgb565_image_data;
-    config->pngs[config->png_count].width = width;
-    config->pngs[config->png_count].height = height;
-    config->pngs[config->png_count].size = total_size;
-    config->png_count++;
+    png->data = pixel_data;
+    png->alpha = alpha_data;
+    png->width = width;
+    png->height = height;
+    png->size = width * height * fmt->Bpp;
     ret = 0;
     goto done;
 
@@ -249,6 +342,14 @@ int add_png(Config *config, struct json_object_s *png_obj) {
         free(image_data);
     }
 
+    if (pixel_data) {
+        free(pixel_data);
+    }
+
+    if (alpha_data) {
+        free(alpha_data);
+    }
+
     done:
     if (row_pointers) {
         free(row_pointers);
@@ -265,10 +366,279 @@ int add_png(Config *config, struct json_object_s *png_obj) {
     return ret;
 }
 
+void png_release(Png *png) {
+    if (png->map) {
+        munmap(png->map, png->map_len);
+    } else {
+        if (png->data) {
+            free(png->data);
+        }
+
+        if (png->alpha) {
+            free(png->alpha);
+        }
+    }
+
+    png->map = NULL;
+    png->data = NULL;
+    png->alpha = NULL;
+}
+
+// reuse the decoded image of the live config if the file did not change, then
+// the on-disk cache of already converted images, then libpng
+static int load_png(Png *png, const PixelFormat *fmt, const Config *live, const char **source) {
+    uint64_t hash = 0;
+    bool hashed = false;
+
+    asset_stamp(png->filename, &png->stamp);
+
+    if (live) {
+        for (size_t i = 0; i < live->png_count; i++) {
+            Png *other = &live->pngs[i];
+            if (other->data && strcmp(other->filename, png->filename) == 0 && asset_unchanged(png->filename, &other->stamp)) {
+                png->size = other->size;
+                png->width = other->width;
+                png->height = other->height;
+                png->data = other->data;
+                png->alpha = other->alpha;
+                png->map = other->map;
+                png->map_len = other->map_len;
+                png->reused_from = other;
+                *source = "reused";
+                return 0;
+            }
+        }
+    }
+
+    hashed = image_cache_key(png->filename, &hash);
+    if (hashed && image_cache_load(hash, fmt, png) == 0) {
+        *source = "cached";
+        return 0;
+    }
+
+    if (decode_png(png->filename, fmt, png) != 0) {
+        return -1;
+    }
+
+    if (hashed) {
+        image_cache_store(hash, fmt, png);
+    }
+
+    *source = "decoded";
+    return 0;
+}
+
+// faces are shared by every config and size using the same file
+static int load_font(Font *font, const char **source) {
+    bool reused = false;
+
+    if (!font_acquire(font, font->filename, font->size, &reused)) {
+        fprintf(stderr, "Error: Could not load font file %s\n", font->filename);
+        return -1;
+    }
+
+    *source = reused ? "reused" : "loaded";
+    return 0;
+}
+
+// discovery: record a png to be loaded by config_load_assets(), once per file
+int config_add_png(Config *config, const char *filename) {
+    for (size_t i = 0; i < config->png_count; i++) {
+        if (strcmp(config->pngs[i].filename, filename) == 0) {
+            return 0;
+        }
+    }
+
+    if (config->png_count == config->png_capacity) {
+        fprintf(stderr, "Error: More pngs than reserved\n");
+        return -1;
+    }
+
+    Png *png = &config->pngs[config->png_count];
+    png->filename = arena_strdup(&config->arena, filename);
+    if (png->filename == NULL) {
+        perror("Error: Memory allocation failed");
+        return -1;
+    }
+
+    config->png_count++;
+    return 0;
+}
+
+int add_png(Config *config, struct json_object_s *png_obj) {
+    struct json_object_element_s *elem = png_obj->start;
+    const char *filename = NULL;
+
+    // walk through png object properties
+    while (elem != NULL) {
+        if (strcmp(elem->name->string, "filename") == 0) {
+            struct json_string_s *value = json_value_as_string(elem->value);
+            filename = value->string;
+        }
+        elem = elem->next;
+    }
+
+    if (!filename) {
+        perror("Error: Could not load png file");
+        return -1;
+    }
+
+    return config_add_png(config, filename);
+}
+
+// discovery: record a font to be loaded by config_load_assets()
+int config_add_font(Config *config, const char *filename, size_t size) {
+    if (!filename || !size) {
+        perror("Error: Could not load font file");
+        return -1;
+    }
+
+    if (config->font_count == config->font_capacity) {
+        fprintf(stderr, "Error: More fonts than reserved\n");
+        return -1;
+    }
+
+    Font *font = &config->fonts[config->font_count];
+    font->filename = arena_strdup(&config->arena, filename);
+    if (font->filename == NULL) {
+        perror("Error: Memory allocation failed");
+        return -1;
+    }
+    font->size = size;
+
+    config->font_count++;
+    return 0;
+}
+
+static void *asset_worker(void *arg) {
+    AssetPool *pool = arg;
+    Config *config = pool->config;
+    struct timespec start, end;
+
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (i >= pool->job_count) {
+            break;
+        }
+
+        AssetJob *job = &pool->jobs[i];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (job->font) {
+            job->ret = load_font(&config->fonts[job->slot], &job->source);
+        } else {
+            job->ret = load_png(&config->pngs[job->slot], config->fmt, pool->live, &job->source);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        job->ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    }
+
+    return NULL;
+}
+
+// load every discovered font and png on a pool of threads, each into its own
+// slot; the calling thread works along. Face creation is serialized by the
+// font manager, so the gain comes from decoding pngs concurrently.
+int config_load_assets(Config *config, const Config *live) {
+    int ret = 0;
+    size_t count = config->font_count + config->png_count;
+    pthread_t threads[ASSET_THREADS_MAX];
+    size_t started = 0;
+    struct timespec start, end;
+
+    if (!count) {
+        return 0;
+    }
+
+    AssetPool pool = {
+        .config = config,
+        .live = live,
+        .job_count = count,
+        .mutex = PTHREAD_MUTEX_INITIALIZER
+    };
+
+    pool.jobs = calloc(count, sizeof(AssetJob));
+    if (pool.jobs == NULL) {
+        perror("Error: Memory allocation failed");
+        return -1;
+    }
+
+    // pngs first, they take longest
+    for (size_t i = 0; i < config->png_count; i++) {
+        pool.jobs[i].slot = i;
+    }
+    for (size_t i = 0; i < config->font_count; i++) {
+        pool.jobs[config->png_count + i].font = true;
+        pool.jobs[config->png_count + i].slot = i;
+    }
+
+    size_t thread_count = config_asset_threads;
+    if (!thread_count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? cpus : 1;
+    }
+    if (thread_count > count) {
+        thread_count = count;
+    }
+    if (thread_count > ASSET_THREADS_MAX) {
+        thread_count = ASSET_THREADS_MAX;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[started], NULL, asset_worker, &pool) != 0) {
+            perror("Failed to create asset loader thread");
+            break;
+        }
+        started++;
+    }
+
+    asset_worker(&pool);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_destroy(&pool.mutex);
+
+    for (size_t i = 0; i < count; i++) {
+        AssetJob *job = &pool.jobs[i];
+        if (job->ret != 0) {
+            ret = -1;
+            continue;
+        }
+
+        if (job->font) {
+            Font *font = &config->fonts[job->slot];
+            config->fonts_reused += strcmp(job->source, "reused") == 0;
+            if (config_asset_report) {
+                printf("  font %s %zupx: %s in %.2f ms\n", font->filename, font->size, job->source, job->ms);
+            }
+        } else {
+            Png *png = &config->pngs[job->slot];
+            config->pngs_reused += png->reused_from != NULL;
+            if (config_asset_report) {
+                printf("  png %s %zux%zu: %s in %.2f ms\n", png->filename, png->width, png->height, job->source, job->ms);
+            }
+        }
+    }
+
+    if (config_asset_report) {
+        printf("Loaded %zu assets in %.1f ms on %zu threads\n", count,
+               (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, started + 1);
+    }
+
+    free(pool.jobs);
+    return ret;
+}
+
 int add_font(Config *config, struct json_object_s *font_obj) {
-    FT_Face f = NULL;
     struct json_object_element_s *elem = font_obj->start;
-    const char* filename;
+    const char* filename = NULL;
     size_t size = 0;
 
     // walk through font object properties
@@ -284,59 +654,76 @@ int add_font(Config *config, struct json_object_s *font_obj) {
         elem = elem->next;
     }
 
-    if (!filename || !size) {
-        perror("Error: Could not load font file");
-        goto cleanup;
-    }
+    return config_add_font(config, filename, size);
+}
 
-    if (!ft_init(filename, &f, &config->ft, size)) {
-        perror("Error: Could not load font file");
-        goto cleanup;
-    }
+int add_history(Config *config, struct json_object_s *history_obj) {
+    struct json_object_element_s *elem = history_obj->start;
 
-    // add font
-    if (config->fonts == NULL) {
-        config->font_count = 0;
-        config->fonts = malloc(sizeof(Font));
-        if (config->fonts == NULL) {
-            perror("Error: Memory allocation failed");
-            goto cleanup;
+    config->history_slots = HISTORY_STORE_SLOTS;
+    config->history_samples = HISTORY_STORE_SAMPLES;
+
+    // walk through history object properties
+    while (elem != NULL) {
+        if (strcmp(elem->name->string, "file") == 0) {
+            struct json_string_s *value = json_value_as_string(elem->value);
+            config->history_file = arena_strdup(&config->arena, value->string);
+            if (config->history_file == NULL) {
+                perror("Error: Memory allocation failed");
+                return -1;
+            }
         }
-    } else {
-        Font *new_ptr = realloc(config->fonts, sizeof(Font) * (config->font_count + 1));
-        if (new_ptr == NULL) {
-            perror("Error: Memory allocation failed");
-            goto cleanup;
+        else if (strcmp(elem->name->string, "identifiers") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long slots = strtol(value->number, NULL, 10);
+            config->history_slots = slots > 1 ? slots : HISTORY_STORE_SLOTS;
         }
-        config->fonts = new_ptr;
-    }
-
-    config->fonts[config->font_count].filename = calloc(1, strlen(filename) + 1);
-    if (config->fonts[config->font_count].filename == NULL) {
-        perror("Error: Memory allocation failed");
-        goto cleanup;
+        else if (strcmp(elem->name->string, "samples") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long samples = strtol(value->number, NULL, 10);
+            config->history_samples = samples > 0 ? samples : HISTORY_STORE_SAMPLES;
+        }
+        elem = elem->next;
     }
-    memcpy(config->fonts[config->font_count].filename, filename, strlen(filename));
 
-    config->fonts[config->font_count].face = f;
-    config->font_count++;
     return 0;
+}
 
-    cleanup:
-    if (f) {
-        free(f);
+int add_export(Config *config, struct json_object_s *export_obj) {
+    struct json_object_element_s *elem = export_obj->start;
+
+    // walk through export object properties
+    while (elem != NULL) {
+        if (strcmp(elem->name->string, "socket") == 0) {
+            struct json_string_s *value = json_value_as_string(elem->value);
+            config->export_socket = arena_strdup(&config->arena, value->string);
+            if (config->export_socket == NULL) {
+                perror("Error: Memory allocation failed");
+                return -1;
+            }
+        }
+        else if (strcmp(elem->name->string, "port") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long port = strtol(value->number, NULL, 10);
+            config->export_port = port > 0 && port < 65536 ? port : 0;
+        }
+        elem = elem->next;
     }
-    return -1;
+
+    return 0;
 }
 
 int add_widget(Config *config, struct json_object_s *widget_obj) {
-    Widget *w = calloc(1, sizeof(Widget));
-    w->scale = 5;
-    if (w == NULL) {
-        perror("Error: Memory allocation failed");
+    if (config->widget_count == config->widget_capacity) {
+        fprintf(stderr, "Error: More widgets than reserved\n");
         return -1;
     }
 
+    // written in place, only counted once complete
+    Widget *w = &config->widgets[config->widget_count];
+    w->scale = 5;
+    w->stale = WIDGET_STALE_DEFAULT;
+
     struct json_object_element_s *elem = widget_obj->start;
     // walk through widget object properties
     while (elem != NULL) {
@@ -386,91 +773,124 @@ int add_widget(Config *config, struct json_object_s *widget_obj) {
             }
             w->scale = scale;
         }
+        else if (strcmp(elem->name->string, "window") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long window = strtol(value->number, NULL, 10);
+            w->window = window > 0 ? window : 0;
+        }
+        else if (strcmp(elem->name->string, "gap") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long gap = strtol(value->number, NULL, 10);
+            w->gap = gap > 0 ? gap : 0;
+        }
+        else if (strcmp(elem->name->string, "stale") == 0) {
+            struct json_number_s *value = json_value_as_number(elem->value);
+            long stale = strtol(value->number, NULL, 10);
+            w->stale = stale > 0 ? stale : 0;
+        }
         else if (strcmp(elem->name->string, "border_color") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->border_color = hex_to_rgb565(value->string);
+            w->border_color = hex_to_color(config->fmt, value->string);
             w->has_border = true;
         }
         else if (strcmp(elem->name->string, "line_color") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->line_color = hex_to_rgb565(value->string);
+            w->line_color = hex_to_color(config->fmt, value->string);
         }
         else if (strcmp(elem->name->string, "type") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->type = calloc(1, strlen(value->string) + 1);
+            w->type = arena_strdup(&config->arena, value->string);
             if (w->type == NULL) {
                 perror("Error: Memory allocation failed");
-                free(w);
                 return -1;
             }
-            memcpy(w->type, value->string, strlen(value->string));
-
+            w->kind = widget_type(w->type);
         }
         else if (strcmp(elem->name->string, "identifier") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->identifier = calloc(1, strlen(value->string) + 1);
+            w->identifier = arena_strdup(&config->arena, value->string);
             if (w->identifier == NULL) {
                 perror("Error: Memory allocation failed");
-                free(w);
                 return -1;
             }
-            memcpy(w->identifier, value->string, strlen(value->string));
+        }
+        else if (strcmp(elem->name->string, "source") == 0) {
+            struct json_string_s *value = json_value_as_string(elem->value);
+            w->source = arena_strdup(&config->arena, value->string);
+            if (w->source == NULL) {
+                perror("Error: Memory allocation failed");
+                return -1;
+            }
         }
         else if (strcmp(elem->name->string, "text") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->text = calloc(1, strlen(value->string) + 1);
+            w->text = arena_strdup(&config->arena, value->string);
             if (w->text == NULL) {
                 perror("Error: Memory allocation failed");
-                free(w);
                 return -1;
             }
-            memcpy(w->text, value->string, strlen(value->string));
         }
         else if (strcmp(elem->name->string, "font") == 0 || strcmp(elem->name->string, "png") == 0) {
             struct json_string_s *value = json_value_as_string(elem->value);
-            w->filename = calloc(1, strlen(value->string) + 1);
+            w->filename = arena_strdup(&config->arena, value->string);
             if (w->filename == NULL) {
                 perror("Error: Memory allocation failed");
-                free(w);
                 return -1;
             }
-            memcpy(w->filename, value->string, strlen(value->string));
         }
         elem = elem->next;
     }
 
-    // add widget
-    if (config->widgets == NULL) {
-        config->widget_count = 0;
-        config->widgets = malloc(sizeof(Widget));
-        if (config->widgets == NULL) {
-            perror("Error: Memory allocation failed");
-            free(w);
-            return -1;
-        }
-    } else {
-        Widget *new_ptr = realloc(config->widgets, sizeof(Widget) * (config->widget_count + 1));
-        if (new_ptr == NULL) {
-            perror("Error: Memory allocation failed");
-            free(w);
-            return -1;
+    config->widget_count++;
+    return 0;
+}
+
+// move assets and widget history the new config shares with the config it
+// replaces, so unloading the old one leaves them alone; returns the number of
+// widgets that kept their history
+size_t config_adopt(Config *config, Config *old) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < config->png_count; i++) {
+        if (config->pngs[i].reused_from) {
+            config->pngs[i].reused_from->map = NULL;
+            config->pngs[i].reused_from->data = NULL;
+            config->pngs[i].reused_from->alpha = NULL;
+            config->pngs[i].reused_from = NULL;
         }
-        config->widgets = new_ptr;
     }
 
-    memcpy(&(config->widgets)[config->widget_count], w, sizeof(Widget));
-    config->widget_count++;
-    free(w);
+    for (size_t i = 0; i < config->widget_count; i++) {
+        Widget *w = &config->widgets[i];
+        if (!w->identifier || !w->kind) {
+            continue;
+        }
 
-    return 0;
+        for (size_t j = 0; j < old->widget_count; j++) {
+            Widget *o = &old->widgets[j];
+            if (o->identifier && o->kind == w->kind && strcmp(w->identifier, o->identifier) == 0 && widget_same_source(w, o)) {
+                if (o->history.levels[0].count || old->hot.value[j]) {
+                    config->hot.value[i] = old->hot.value[j];
+                    config->hot.updated[i] = old->hot.updated[j];
+                    widget_adopt_history(w, o);
+                    kept++;
+                }
+                break;
+            }
+        }
+    }
+
+    return kept;
 }
 
-int load_config(const char *filename, Config *config) {
+int load_config(const char *filename, Config *config, const PixelFormat *fmt, const Config *live) {
     int ret = -1;
     struct json_value_s *root = NULL;
     char *content = NULL;
     FILE *fd = NULL;
 
+    config->fmt = fmt;
+
     // Open and read the JSON file
     fd = fopen(filename, "r");
     if (!fd) {
@@ -497,10 +917,37 @@ int load_config(const char *filename, Config *config) {
         goto cleanup;
     }
 
+    // size the arrays up front, everything lands in one arena block
+    size_t counts[3] = {0};
+    const char *arrays[3] = {"widgets", "fonts", "pngs"};
     struct json_object_s *obj = json_value_as_object(root);
+    for (struct json_object_element_s *elem = obj->start; elem; elem = elem->next) {
+        for (size_t i = 0; i < 3; i++) {
+            if (strcmp(elem->name->string, arrays[i]) == 0 && elem->value->type == json_type_array) {
+                counts[i] += json_value_as_array(elem->value)->length;
+            }
+        }
+    }
+
+    config->arena.block_size = sizeof(Widget) * counts[0] + sizeof(Font) * counts[1] + sizeof(Png) * counts[2] +
+                               (sizeof(double) + 2 + 4 * sizeof(uint32_t)) * counts[0] + length + ARENA_BLOCK_SIZE;
+    if (config_reserve(config, counts[0], counts[1], counts[2]) != 0) {
+        goto cleanup;
+    }
+
     struct json_object_element_s *elem = obj->start;
     while (elem != NULL) {
-        if ((strcmp(elem->name->string, "widgets") == 0 || strcmp(elem->name->string, "fonts") == 0 || strcmp(elem->name->string, "pngs") == 0) && elem->value->type == json_type_array) {
+        if (strcmp(elem->name->string, "history") == 0 && elem->value->type == json_type_object) {
+            if (add_history(config, json_value_as_object(elem->value)) != 0) {
+                goto cleanup;
+            }
+        }
+        else if (strcmp(elem->name->string, "export") == 0 && elem->value->type == json_type_object) {
+            if (add_export(config, json_value_as_object(elem->value)) != 0) {
+                goto cleanup;
+            }
+        }
+        else if ((strcmp(elem->name->string, "widgets") == 0 || strcmp(elem->name->string, "fonts") == 0 || strcmp(elem->name->string, "pngs") == 0) && elem->value->type == json_type_array) {
             struct json_array_s* array = json_value_as_array(elem->value);
             struct json_array_element_s* array_elem = array->start;
             // walk through array of widgets
@@ -528,17 +975,22 @@ int load_config(const char *filename, Config *config) {
         elem = elem->next;
     }
 
+    // every asset is known now, load them all before linking
+    if (config_load_assets(config, live) != 0) {
+        goto cleanup;
+    }
+
     // go through widgets and link them to their fonts/pngs if appropriate
     for (size_t i = 0; i < config->widget_count; i++) {
         if (config->widgets[i].filename) {
-            if (strcmp(config->widgets[i].type, "text") == 0 || strcmp(config->widgets[i].type, "value") == 0) {
+            if (config->widgets[i].kind == WIDGET_TEXT || config->widgets[i].kind == WIDGET_VALUE || config->widgets[i].kind == WIDGET_STATS) {
                 for(size_t j = 0; j < config->font_count; j++) {
                     if (config->fonts[j].filename && strcmp(config->widgets[i].filename, config->fonts[j].filename) == 0) {
-                        config->widgets[i].face = config->fonts[j].face;
+                        config->widgets[i].font = &config->fonts[j];
                     }
                 }
             }
-            else if (strcmp(config->widgets[i].type, "png") == 0) {
+            else if (config->widgets[i].kind == WIDGET_PNG) {
                 for(size_t j = 0; j < config->png_count; j++) {
                     if (config->pngs[j].filename && strcmp(config->widgets[i].filename, config->pngs[j].filename) == 0) {
                         config->widgets[i].png = &config->pngs[j];
@@ -548,6 +1000,10 @@ int load_config(const char *filename, Config *config) {
         }
     }
 
+    if (config_build_index(config) != 0 || config_build_hot(config) != 0 || config_init_history(config) != 0) {
+        goto cleanup;
+    }
+
     ret = 0;
 
     cleanup:
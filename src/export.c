@@ -0,0 +1,427 @@
+#include "export.h"
+
+static const struct {
+    StatsCounter counter;
+    const char *name;
+    const char *help;
+} export_counters[] = {
+    {STAT_PACKETS, "rtop_packets_total", "Packets received with a valid checksum."},
+    {STAT_DROPPED, "rtop_dropped_total", "Packets dropped before the render loop used them."},
+    {STAT_CRC_ERRORS, "rtop_crc_errors_total", "Packets with a checksum mismatch."},
+    {STAT_LOST, "rtop_lost_total", "Sequence numbers that never arrived."},
+    {STAT_DUPLICATES, "rtop_duplicates_total", "Packets rejected as a repeat of one already taken."},
+    {STAT_REORDERED, "rtop_reordered_total", "Packets rejected for arriving after a newer one."},
+    {STAT_PARSED, "rtop_parsed_total", "Packets parsed and routed by the render loop."},
+    {STAT_COPY_BYTES, "rtop_copy_bytes_total", "Bytes copied out of inflated payloads into parsed documents."},
+    {STAT_FRAMES, "rtop_frames_total", "Passes of the render loop."},
+    {STAT_REDRAWS, "rtop_redraws_total", "Frames drawn and swapped."},
+    {STAT_UPLOAD_BYTES, "rtop_upload_bytes_total", "Bytes copied to the framebuffer."},
+};
+
+static int text_append(ExportText *t, const char *format, ...) {
+    va_list args;
+
+    for (;;) {
+        size_t room = t->capacity - t->len;
+
+        va_start(args, format);
+        int n = vsnprintf(t->data ? t->data + t->len : NULL, room, format, args);
+        va_end(args);
+
+        if (n < 0) {
+            return -1;
+        }
+        if ((size_t)n < room) {
+            t->len += n;
+            return 0;
+        }
+
+        size_t capacity = t->capacity ? t->capacity * 2 : 4096;
+        while (capacity - t->len <= (size_t)n) {
+            capacity *= 2;
+        }
+        char *data = realloc(t->data, capacity);
+        if (data == NULL) {
+            return -1;
+        }
+        t->data = data;
+        t->capacity = capacity;
+    }
+}
+
+// label values escape backslashes, quotes and newlines
+static int text_append_label(ExportText *t, const char *s) {
+    for (; *s; s++) {
+        int ret;
+        if (*s == '\\' || *s == '"') {
+            ret = text_append(t, "\\%c", *s);
+        } else if (*s == '\n') {
+            ret = text_append(t, "\\n");
+        } else {
+            ret = text_append(t, "%c", *s);
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Stats socket path %s is too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error: Could not create stats socket");
+        return -1;
+    }
+
+    // a socket left behind by a previous run; anything else at the path is
+    // left alone and the bind fails
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, EXPORT_BACKLOG) < 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int listen_loopback(uint16_t port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    int reuse = 1;
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error: Could not create stats socket");
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, EXPORT_BACKLOG) < 0) {
+        fprintf(stderr, "Error: Could not listen on 127.0.0.1:%u: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// listen on the socket path and/or loopback port, NULL if neither works
+Exporter *exporter_open(const char *socket_path, uint16_t port, Ingest **ingests, size_t ingest_count) {
+    Exporter *e = calloc(1, sizeof(Exporter));
+    if (e == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    if (socket_path) {
+        int fd = listen_unix(socket_path);
+        if (fd >= 0) {
+            e->socket_path = strdup(socket_path);
+            e->fds[e->fd_count++] = fd;
+            printf("Stats on %s\n", socket_path);
+        }
+    }
+
+    if (port) {
+        int fd = listen_loopback(port);
+        if (fd >= 0) {
+            e->port = port;
+            e->fds[e->fd_count++] = fd;
+            printf("Stats on 127.0.0.1:%u\n", port);
+        }
+    }
+
+    if (!e->fd_count) {
+        free(e);
+        return NULL;
+    }
+
+    memcpy(e->ingests, ingests, sizeof(Ingest *) * ingest_count);
+    e->ingest_count = ingest_count;
+    e->back = &e->buffers[0];
+    e->front = &e->buffers[1];
+    atomic_store(&e->middle, (uintptr_t)&e->buffers[2]);
+
+    return e;
+}
+
+// after the export thread has been joined
+void exporter_close(Exporter *e) {
+    if (e == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < e->fd_count; i++) {
+        close(e->fds[i]);
+    }
+
+    if (e->socket_path) {
+        unlink(e->socket_path);
+        free(e->socket_path);
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        free(e->buffers[i].data);
+    }
+    free(e->response.data);
+    free(e);
+}
+
+// whether w is the first widget for its identifier and source
+static bool export_first(const Config *config, const Widget *w) {
+    for (const Widget *other = config_find_widget(config, w->identifier); other != w; other = other->next_same) {
+        if (widget_same_source(other, w)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// render loop: format the current value of every routed identifier, per
+// source for widgets that name one, into the back buffer and hand it over;
+// a graph's value is its newest sample
+void exporter_publish(Exporter *e, const Config *config) {
+    if (e == NULL) {
+        return;
+    }
+
+    ExportText *t = e->back;
+    t->len = 0;
+
+    for (size_t i = 0; i < config->widget_count; i++) {
+        Widget *w = &config->widgets[i];
+
+        if (!w->identifier || !export_first(config, w)) {
+            continue;
+        }
+
+        for (Widget *same = w; same; same = same->next_same) {
+            size_t j = same - config->widgets;
+            const HistoryLevel *raw = &same->history.levels[0];
+            double value;
+
+            if (!widget_same_source(same, w)) {
+                continue;
+            } else if (config->hot.kind[j] == WIDGET_VALUE) {
+                value = config->hot.value[j];
+            } else if (config->hot.kind[j] == WIDGET_GRAPH && same->history.level_count && raw->count) {
+                const Sample *s = history_at(raw, 0);
+                value = s->sum / s->count;
+            } else {
+                continue;
+            }
+
+            int ret = text_append(t, "rtop_value{identifier=\"") | text_append_label(t, w->identifier);
+            if (w->source) {
+                ret |= text_append(t, "\",source=\"") | text_append_label(t, w->source);
+            }
+            if ((ret | text_append(t, "\"} %.17g\n", value)) != 0) {
+                t->len = 0;
+                return;
+            }
+            break;
+        }
+    }
+
+    uintptr_t old = atomic_exchange(&e->middle, (uintptr_t)t | 1);
+    e->back = (ExportText *)(old & ~(uintptr_t)1);
+}
+
+// export thread: take the newest published values if there are any
+static const ExportText *exporter_values(Exporter *e) {
+    if (atomic_load(&e->middle) & 1) {
+        uintptr_t old = atomic_exchange(&e->middle, (uintptr_t)e->front);
+        e->front = (ExportText *)(old & ~(uintptr_t)1);
+    }
+    return e->front;
+}
+
+static const struct {
+    size_t offset;
+    const char *name;
+    const char *help;
+} export_source_counters[] = {
+    {offsetof(IngestSource, packets), "rtop_source_packets_total", "Packets taken from each sender."},
+    {offsetof(IngestSource, lost), "rtop_source_lost_total", "Sequence numbers from each sender that never arrived."},
+    {offsetof(IngestSource, duplicates), "rtop_source_duplicates_total", "Packets from each sender rejected as a repeat."},
+    {offsetof(IngestSource, reordered), "rtop_source_reordered_total", "Packets from each sender rejected for arriving late."},
+};
+
+// the labels of a sender, naming its listener if there are several; a
+// sender spread over listeners by its port shows up once under each
+static int text_append_source(ExportText *t, const char *name, const Ingest *in, const IngestSource *s) {
+    int ret = text_append(t, "%s{source=\"", name) | text_append_label(t, s->name);
+    if (in->listeners > 1) {
+        ret |= text_append(t, "\",listener=\"%zu", in->listener);
+    }
+    return ret | text_append(t, "\"}");
+}
+
+// the listeners' tables of senders, each held still while it is read
+static int exporter_format_sources(Exporter *e, ExportText *t) {
+    uint64_t now = stats_ns();
+    int ret = 0;
+
+    for (size_t i = 0; i < sizeof(export_source_counters) / sizeof(export_source_counters[0]); i++) {
+        ret |= text_append(t, "# HELP %s %s\n# TYPE %s counter\n", export_source_counters[i].name,
+                           export_source_counters[i].help, export_source_counters[i].name);
+        for (size_t l = 0; l < e->ingest_count; l++) {
+            Ingest *in = e->ingests[l];
+            pthread_mutex_lock(&in->sources_mutex);
+            for (size_t j = 0; j < in->source_count; j++) {
+                IngestSource *s = &in->sources[j];
+                _Atomic uint64_t *counter = (_Atomic uint64_t *)((char *)s + export_source_counters[i].offset);
+                ret |= text_append_source(t, export_source_counters[i].name, in, s);
+                ret |= text_append(t, " %" PRIu64 "\n", atomic_load_explicit(counter, memory_order_relaxed));
+            }
+            pthread_mutex_unlock(&in->sources_mutex);
+        }
+    }
+
+    ret |= text_append(t, "# HELP rtop_source_age_seconds Time since each sender's last packet.\n"
+                          "# TYPE rtop_source_age_seconds gauge\n");
+    for (size_t l = 0; l < e->ingest_count; l++) {
+        Ingest *in = e->ingests[l];
+        pthread_mutex_lock(&in->sources_mutex);
+        for (size_t j = 0; j < in->source_count; j++) {
+            IngestSource *s = &in->sources[j];
+            uint64_t last_seen = atomic_load_explicit(&s->last_seen, memory_order_relaxed);
+            ret |= text_append_source(t, "rtop_source_age_seconds", in, s);
+            ret |= text_append(t, " %.3f\n", now > last_seen ? (now - last_seen) / 1e9 : 0.0);
+        }
+        pthread_mutex_unlock(&in->sources_mutex);
+    }
+
+    return ret;
+}
+
+static int exporter_format(Exporter *e, ExportText *t) {
+    StatsTotals totals;
+    int ret = 0;
+
+    stats_collect(&totals);
+    t->len = 0;
+
+    for (size_t i = 0; i < sizeof(export_counters) / sizeof(export_counters[0]); i++) {
+        ret |= text_append(t, "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu64 "\n", export_counters[i].name,
+                           export_counters[i].help, export_counters[i].name, export_counters[i].name,
+                           totals.counters[export_counters[i].counter]);
+    }
+
+    ret |= text_append(t, "# HELP rtop_stage_seconds Time taken by each run of a stage.\n"
+                          "# TYPE rtop_stage_seconds histogram\n");
+    for (size_t i = 0; i < STATS_STAGES; i++) {
+        const char *stage = stats_stage_names[i];
+        uint64_t count = 0;
+
+        for (size_t j = 0; j < STATS_BUCKETS; j++) {
+            count += totals.hist[i][j];
+            if (j + 1 < STATS_BUCKETS) {
+                ret |= text_append(t, "rtop_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %" PRIu64 "\n", stage, (1ULL << j) / 1e6, count);
+            } else {
+                ret |= text_append(t, "rtop_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", stage, count);
+            }
+        }
+        ret |= text_append(t, "rtop_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage, totals.counters[stats_stage_counters[i]] / 1e9);
+        ret |= text_append(t, "rtop_stage_seconds_count{stage=\"%s\"} %" PRIu64 "\n", stage, count);
+    }
+
+    ret |= exporter_format_sources(e, t);
+
+    const ExportText *values = exporter_values(e);
+    ret |= text_append(t, "# HELP rtop_value Current value of each routed identifier.\n# TYPE rtop_value gauge\n");
+    ret |= text_append(t, "%.*s", (int)values->len, values->data ? values->data : "");
+
+    return ret;
+}
+
+// answer any request with the metrics, the request itself is not looked at
+static void exporter_serve(Exporter *e, int fd) {
+    char request[EXPORT_REQUEST_MAX];
+    char header[160];
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+    if (poll(&pfd, 1, EXPORT_TIMEOUT_MS) > 0) {
+        if (recv(fd, request, sizeof(request), 0) < 0) {
+            return;
+        }
+    }
+
+    if (exporter_format(e, &e->response) != 0) {
+        fprintf(stderr, "Error: Could not format stats\n");
+        return;
+    }
+
+    int len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: %zu\r\nConnection: close\r\n\r\n", e->response.len);
+
+    const char *parts[2] = {header, e->response.data};
+    size_t sizes[2] = {len, e->response.len};
+
+    for (size_t i = 0; i < 2; i++) {
+        size_t sent = 0;
+        while (sent < sizes[i]) {
+            ssize_t n = send(fd, parts[i] + sent, sizes[i] - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;
+            }
+            sent += n;
+        }
+    }
+}
+
+void *stats_exporter(void *arg) {
+    Exporter *e = arg;
+    struct pollfd pfds[2];
+
+    // stay out of the render loop's way; on Linux this is the calling
+    // thread's nice value only
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0) {
+        perror("Warning: Could not lower stats thread priority");
+    }
+
+    for (size_t i = 0; i < e->fd_count; i++) {
+        pfds[i].fd = e->fds[i];
+        pfds[i].events = POLLIN;
+    }
+
+    while (running) {
+        int ready = poll(pfds, e->fd_count, EXPORT_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("Error: Stats poll failed");
+            break;
+        }
+
+        for (size_t i = 0; ready > 0 && i < e->fd_count; i++) {
+            if (!(pfds[i].revents & POLLIN)) {
+                continue;
+            }
+
+            int client = accept(pfds[i].fd, NULL, NULL);
+            if (client < 0) {
+                continue;
+            }
+            exporter_serve(e, client);
+            close(client);
+        }
+    }
+
+    return NULL;
+}
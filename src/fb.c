@@ -1,13 +1,5 @@
 #include "fb.h"
 
-uint16_t rgb_to_rgb565(uint8_t r, uint8_t g, uint8_t b) {
-    uint16_t rs = (r * 31) / 255;
-    uint16_t gs = (g * 63) / 255;
-    uint16_t bs = (b * 31) / 255;
-
-    return (rs << 11) | (gs << 5) | bs;
-}
-
 void fb_set_graphics_mode() {
     char *tty_n = "/dev/tty0";
     int console_fd;
@@ -29,6 +21,8 @@ void fb_set_graphics_mode() {
 }
 
 FrameBuffer* fb_init() {
+    simd_init();
+
     FrameBuffer *fb = calloc(1, sizeof(FrameBuffer));
     if (fb == NULL) {
         perror("Unable to allocate FrameBuffer.");
@@ -54,6 +48,14 @@ FrameBuffer* fb_init() {
         goto cleanup;
     }
 
+    fb->fmt = pixel_format_from_var(&vinfo);
+    if (!fb->fmt) {
+        fprintf(stderr, "Unsupported pixel format (%u bpp, red %u/%u, green %u/%u, blue %u/%u)\n",
+                vinfo.bits_per_pixel, vinfo.red.offset, vinfo.red.length, vinfo.green.offset,
+                vinfo.green.length, vinfo.blue.offset, vinfo.blue.length);
+        goto cleanup;
+    }
+
     fb->w = vinfo.xres;
     fb->h = vinfo.yres;
     fb->stride = finfo.line_length;
@@ -68,13 +70,30 @@ FrameBuffer* fb_init() {
         goto cleanup;
     }
 
-    fb->bb = malloc(fb->sz);
+    fb->bb = calloc(1, fb->sz);
     if (!fb->bb) {
         perror("Error allocating back buffer");
         goto cleanup;
     }
 
+    // static layer, composited once and copied into the back buffer each frame
+    fb->bg = calloc(1, fb->sz);
+    if (!fb->bg) {
+        perror("Error allocating background buffer");
+        goto cleanup;
+    }
+
+    fb->damage = malloc(fb->h);
+    if (!fb->damage) {
+        perror("Error allocating damage rows");
+        goto cleanup;
+    }
+    memset(fb->damage, DAMAGE_CURRENT, fb->h);
+
     fb_set_graphics_mode();
+    fb_calibrate_upload(fb);
+
+    printf("Framebuffer %ldx%ld %s, stride %ld, %s, upload %s\n", fb->w, fb->h, fb->fmt->name, fb->stride, simd->name, fb->upload_name);
 
     return fb;
 
@@ -84,16 +103,67 @@ FrameBuffer* fb_init() {
     return NULL;
 }
 
+// in-memory framebuffer with no device behind it, used for benchmarking
+FrameBuffer* fb_init_headless(size_t w, size_t h, const PixelFormat *fmt) {
+    simd_init();
+
+    FrameBuffer *fb = calloc(1, sizeof(FrameBuffer));
+    if (fb == NULL) {
+        perror("Unable to allocate FrameBuffer.");
+        return NULL;
+    }
+
+    fb->fd = -1;
+    fb->headless = true;
+    fb->fmt = fmt;
+    fb->w = w;
+    fb->h = h;
+    fb->bpp = fmt->bpp;
+    fb->Bpp = fmt->Bpp;
+    fb->stride = w * fb->Bpp;
+    fb->sz = h * fb->stride;
+
+    fb->ptr = calloc(1, fb->sz);
+    fb->bb = calloc(1, fb->sz);
+    fb->bg = calloc(1, fb->sz);
+    fb->damage = malloc(fb->h);
+    if (!fb->ptr || !fb->bb || !fb->bg || !fb->damage) {
+        perror("Error allocating headless framebuffer");
+        fb_deinit(fb);
+        return NULL;
+    }
+    memset(fb->damage, DAMAGE_CURRENT, fb->h);
+
+    fb->upload_name = "stream";
+    fb->upload = simd->stream;
+
+    return fb;
+}
+
 void fb_deinit(FrameBuffer *fb) {
     if (fb->bb) {
         free(fb->bb);
         fb->bb = NULL;
     }
+    if (fb->bg) {
+        free(fb->bg);
+        fb->bg = NULL;
+    }
+    if (fb->damage) {
+        free(fb->damage);
+        fb->damage = NULL;
+    }
     if (fb->ptr) {
-        munmap(fb->ptr, fb->sz);
+        if (fb->headless) {
+            free(fb->ptr);
+        } else {
+            munmap(fb->ptr, fb->sz);
+        }
         fb->ptr = NULL;
     }
-    close(fb->fd);
+    if (fb->fd >= 0) {
+        close(fb->fd);
+    }
     if (fb) {
         free(fb);
     }
@@ -101,76 +171,239 @@ void fb_deinit(FrameBuffer *fb) {
     fb = NULL;
 }
 
+static inline void fb_mark_damage(FrameBuffer *fb, size_t y1, size_t y2) {
+    if (y2 >= fb->h) {
+        y2 = fb->h - 1;
+    }
+
+    for (size_t y = y1; y <= y2; y++) {
+        fb->damage[y] |= DAMAGE_CURRENT;
+    }
+}
+
 void fb_clear(FrameBuffer *fb) {
-    memset(fb->bb, 0, fb->sz);
+    fb_fill_rect(fb, 0, 0, fb->w, fb->h, 0);
 }
 
-void fb_draw_line(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint16_t rgb565) {
-    int dx = abs((int)x2 - (int)x1);
-    int dy = abs((int)y2 - (int)y1);
-    int sx = x1 < x2 ? 1 : -1;
-    int sy = y1 < y2 ? 1 : -1;
-    int err = dx - dy;
+void fb_save_background(FrameBuffer *fb) {
+    simd->copy(fb->bg, fb->bb, fb->sz);
+    fb_mark_damage(fb, 0, fb->h - 1);
+}
 
-    while (1) {
-        fb_set_pixel(fb, x1, y1, rgb565);
+void fb_restore_background(FrameBuffer *fb) {
+    simd->copy(fb->bb, fb->bg, fb->sz);
+}
 
-        if (x1 == x2 && y1 == y2) {
-            break;
-        }
+uint32_t fb_rgb(FrameBuffer *fb, uint8_t r, uint8_t g, uint8_t b) {
+    return fb->fmt->rgb(r, g, b);
+}
+
+void fb_draw_line(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint32_t color) {
+    fb_mark_damage(fb, y1 < y2 ? y1 : y2, y1 < y2 ? y2 : y1);
+    fb->fmt->draw_line(fb, x1, y1, x2, y2, color);
+}
+
+void fb_draw_line_shaded(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint32_t line_color, uint32_t shade_color) {
+    size_t y_max = y1 < y2 ? y2 : y1;
+    fb_mark_damage(fb, y1 < y2 ? y1 : y2, y_max > bottom ? y_max : bottom);
+    fb->fmt->draw_line_shaded(fb, x1, y1, x2, y2, bottom, line_color, shade_color);
+}
+
+void fb_fill_rect(FrameBuffer *fb, size_t x, size_t y, size_t w, size_t h, uint32_t color) {
+    if (x >= fb->w || y >= fb->h) {
+        return;
+    }
+
+    if (w > fb->w - x) {
+        w = fb->w - x;
+    }
+
+    if (h > fb->h - y) {
+        h = fb->h - y;
+    }
 
-        int e2 = 2 * err;
+    fb_mark_damage(fb, y, y + h - 1);
 
-        if (e2 > -dy) {
-            err -= dy;
-            x1 += sx;
+    uint8_t *dst = fb->bb + y * fb->stride + x * fb->Bpp;
+    for (size_t i = 0; i < h; i++) {
+        fb->fmt->hspan(dst, w, color);
+        dst += fb->stride;
+    }
+}
+
+void fb_hspan(FrameBuffer *fb, size_t x, size_t y, size_t n, uint32_t color) {
+    fb_fill_rect(fb, x, y, n, 1, color);
+}
+
+void fb_vspan(FrameBuffer *fb, size_t x, size_t y, size_t n, uint32_t color) {
+    if (x >= fb->w || y >= fb->h) {
+        return;
+    }
+
+    if (n > fb->h - y) {
+        n = fb->h - y;
+    }
+
+    if (!n) {
+        return;
+    }
+
+    fb_mark_damage(fb, y, y + n - 1);
+    fb->fmt->vspan(fb->bb + y * fb->stride + x * fb->Bpp, fb->stride, n, color);
+}
+
+// draw color wherever an 8 bit coverage mask (e.g. a glyph bitmap) is set
+void fb_draw_mask(FrameBuffer *fb, const uint8_t *mask, size_t pitch, size_t w, size_t h, long x, long y, uint32_t color) {
+    if (x < 0) {
+        if ((size_t)-x >= w) {
+            return;
         }
+        mask += -x;
+        w -= -x;
+        x = 0;
+    }
 
-        if (e2 < dx) {
-            err += dx;
-            y1 += sy;
+    if (y < 0) {
+        if ((size_t)-y >= h) {
+            return;
         }
+        mask += -y * pitch;
+        h -= -y;
+        y = 0;
+    }
+
+    if ((size_t)x >= fb->w || (size_t)y >= fb->h) {
+        return;
+    }
+
+    if (w > fb->w - x) {
+        w = fb->w - x;
+    }
+
+    if (h > fb->h - y) {
+        h = fb->h - y;
+    }
+
+    if (!w || !h) {
+        return;
+    }
+
+    fb_mark_damage(fb, y, y + h - 1);
+    fb->fmt->draw_mask(fb->bb + y * fb->stride + x * fb->Bpp, fb->stride, mask, pitch, w, h, color);
+}
+
+void fb_set_pixel(FrameBuffer *fb, size_t x, size_t y, uint32_t color) {
+    if (x < fb->w && y < fb->h) {
+        fb->damage[y] |= DAMAGE_CURRENT;
+        fb->fmt->put(fb->bb + y * fb->stride + x * fb->Bpp, color);
     }
 }
 
-void fb_draw_line_shaded(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint16_t line_color, uint16_t shade_color) {
-    int dx = abs((int)x2 - (int)x1);
-    int dy = abs((int)y2 - (int)y1);
-    int sx = x1 < x2 ? 1 : -1;
-    int sy = y1 < y2 ? 1 : -1;
-    int err = dx - dy;
+// copy an image in the framebuffer's pixel format into the back buffer,
+// clipped once against the screen; opaque images are copied a row at a time,
+// images with an alpha plane are blended
+void fb_blit(FrameBuffer *fb, const uint8_t *src, const uint8_t *alpha, size_t src_w, size_t src_h, size_t left, size_t top) {
+    if (left >= fb->w || top >= fb->h) {
+        return;
+    }
 
-    while (1) {
-        fb_set_pixel(fb, x1, y1, line_color);
+    size_t w = src_w < fb->w - left ? src_w : fb->w - left;
+    size_t h = src_h < fb->h - top ? src_h : fb->h - top;
+    size_t src_stride = src_w * fb->Bpp;
+    uint8_t *dst = fb->bb + top * fb->stride + left * fb->Bpp;
 
-        if (x1 == x2 && y1 == y2) {
-            break;
+    if (!w || !h) {
+        return;
+    }
+
+    fb_mark_damage(fb, top, top + h - 1);
+
+    for (size_t y = 0; y < h; y++) {
+        if (alpha) {
+            fb->fmt->blend_row(dst, src, alpha, w);
+            alpha += src_w;
+        } else {
+            memcpy(dst, src, w * fb->Bpp);
         }
+        dst += fb->stride;
+        src += src_stride;
+    }
+}
+
+static void upload_memcpy(uint8_t *dst, const uint8_t *src, size_t n) {
+    memcpy(dst, src, n);
+}
 
-        int e2 = 2 * err;
+static uint64_t elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000ULL + end->tv_nsec - start->tv_nsec;
+}
+
+// device memory is usually uncached or write-combined and behaves very
+// differently from system memory, so time every upload routine against the
+// real mapping and keep the fastest
+void fb_calibrate_upload(FrameBuffer *fb) {
+    const SimdOps *variants[4];
+    size_t count = simd_variants(variants, 4);
+    struct timespec start, end;
+    uint64_t best_ns = UINT64_MAX;
+
+    fb->upload_name = "memcpy";
+    fb->upload = upload_memcpy;
+
+    for (size_t i = 0; i <= count; i++) {
+        const char *name = i == 0 ? "memcpy" : variants[i - 1]->name;
+        void (*upload)(uint8_t *, const uint8_t *, size_t) = i == 0 ? upload_memcpy : variants[i - 1]->stream;
+        uint64_t ns = UINT64_MAX;
+
+        // scalar stream is memcpy too
+        if (i > 0 && upload == variants[0]->stream) {
+            continue;
+        }
 
-        if (e2 > -dy) {
-            err -= dy;
-            x1 += sx;
-            if (y1 < bottom) {
-                fb_draw_line(fb, x1, y1 + 1, x1, bottom, shade_color);
+        for (int pass = 0; pass < 3; pass++) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            upload(fb->ptr, fb->bb, fb->sz);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (elapsed_ns(&start, &end) < ns) {
+                ns = elapsed_ns(&start, &end);
             }
         }
 
-        if (e2 < dx) {
-            err += dx;
-            y1 += sy;
+        printf("Upload %-8s %8.1f MB/s\n", name, ns ? fb->sz * 1e3 / ns : 0.0);
+
+        if (ns < best_ns) {
+            best_ns = ns;
+            fb->upload_name = name;
+            fb->upload = upload;
         }
     }
 }
 
-void fb_set_pixel(FrameBuffer *fb, size_t x, size_t y, uint16_t rgb565) {
-    if (x < fb->w && y < fb->h) {
-        size_t pixel_offset = y * fb->w + x;
-        ((uint16_t *)fb->bb)[pixel_offset] = rgb565;
+// upload runs of damaged rows; the device mapping is never read back
+void fb_swap(FrameBuffer *fb) {
+    struct timespec start, end;
+    size_t y = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (y < fb->h) {
+        if (!fb->damage[y]) {
+            y++;
+            continue;
+        }
+
+        size_t first = y;
+        while (y < fb->h && fb->damage[y]) {
+            fb->damage[y] = (fb->damage[y] & DAMAGE_CURRENT) ? DAMAGE_PREVIOUS : 0;
+            y++;
+        }
+
+        size_t offset = first * fb->stride;
+        size_t n = (y - first) * fb->stride;
+        fb->upload(fb->ptr + offset, fb->bb + offset, n);
+        fb->upload_bytes += n;
     }
-}
 
-void fb_swap(FrameBuffer *fb) {
-    memcpy(fb->ptr, fb->bb, fb->sz);
-}
\ No newline at end of file
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fb->upload_ns += elapsed_ns(&start, &end);
+}
@@ -1,5 +1,15 @@
 #include "ft.h"
 
+// Process wide font manager: a single FreeType library shared by every config,
+// including the ones built by the reload thread, hence the mutex. A face is
+// not thread safe either: the active size and glyph slot change on every
+// draw, so rendering holds the mutex as well as creating and dropping sizes.
+static struct {
+    FT_Library ft;
+    FontFile *files;
+    pthread_mutex_t mutex;
+} fonts = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
 int face_get_line_spacing(FT_Face face)
 {
     return face->size->metrics.height / 64;
@@ -99,7 +109,7 @@ int32_t *utf8_to_utf32(const char *utf8_word)
     return utf32_word;
 }
 
-void ft_draw_char(FT_Face face, FrameBuffer *fb, int c, size_t *x, size_t y, uint16_t color) {
+void ft_draw_char(FT_Face face, FrameBuffer *fb, int c, size_t *x, size_t y, uint32_t color) {
     FT_UInt gi = FT_Get_Char_Index (face, c);
     FT_Load_Glyph (face, gi, FT_LOAD_DEFAULT);
     int y_off = face->size->metrics.ascender/64 - face->glyph->metrics.horiBearingY/64;
@@ -108,66 +118,235 @@ void ft_draw_char(FT_Face face, FrameBuffer *fb, int c, size_t *x, size_t y, uin
     int x_off = (advance - glyph_width) / 2;
     FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
 
-    for (int i = 0; i < (int)face->glyph->bitmap.rows; i++)
-    {
-        int row_offset = y + i + y_off;
-        for (int j = 0; j < (int)face->glyph->bitmap.width; j++)
-        {
-            unsigned char p = face->glyph->bitmap.buffer [i * face->glyph->bitmap.pitch + j];
-            if (p)
-            {
-                fb_set_pixel(fb, *x + j + x_off, row_offset, color);
-            }
-        }
+    FT_Bitmap *bitmap = &face->glyph->bitmap;
+    if (bitmap->pitch > 0) {
+        fb_draw_mask(fb, bitmap->buffer, bitmap->pitch, bitmap->width, bitmap->rows, (long)*x + x_off, (long)y + y_off, color);
     }
     *x += advance;
 }
 
-void ft_draw_string(FT_Face face, FrameBuffer *fb, const char *s, size_t x, size_t y, uint16_t color)
+size_t ft_line_height(Font *font)
+{
+    pthread_mutex_lock(&fonts.mutex);
+    FT_Activate_Size(font->sized->size);
+    size_t height = face_get_line_spacing(font->file->face);
+    pthread_mutex_unlock(&fonts.mutex);
+    return height;
+}
+
+void ft_draw_string(Font *font, FrameBuffer *fb, const char *s, size_t x, size_t y, uint32_t color)
 {
+    FT_Face face = font->file->face;
     int32_t *s32 = utf8_to_utf32(s);
     int32_t *t = s32;
 
+    pthread_mutex_lock(&fonts.mutex);
+    FT_Activate_Size(font->sized->size);
     while (*t)
     {
         ft_draw_char(face, fb, *t, &x, y, color);
         t++;
     }
+    pthread_mutex_unlock(&fonts.mutex);
 
     if (s32) {
         free(s32);
     }
 }
 
-bool ft_init(const char* ttf_file, FT_Face* face, FT_Library* ft, int req_size)
+static FontFile *font_file_open(const char *filename) {
+    FontFile *file = calloc(1, sizeof(FontFile));
+    int fd = -1;
+    struct stat st;
+
+    if (file == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    file->filename = strdup(filename);
+    if (file->filename == NULL) {
+        perror("Error: Memory allocation failed");
+        goto cleanup;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        perror("Can't open TTF file");
+        goto cleanup;
+    }
+
+    file->stamp.mtime = st.st_mtim;
+    file->stamp.size = st.st_size;
+    file->map_len = st.st_size;
+    file->map = mmap(NULL, file->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file->map == MAP_FAILED) {
+        file->map = NULL;
+        perror("Can't map TTF file");
+        goto cleanup;
+    }
+
+    if (FT_New_Memory_Face(fonts.ft, file->map, file->map_len, 0, &file->face) != 0) {
+        perror("Can't load TTF file");
+        goto cleanup;
+    }
+
+    close(fd);
+    return file;
+
+    cleanup:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (file->map) {
+        munmap(file->map, file->map_len);
+    }
+    if (file->filename) {
+        free(file->filename);
+    }
+    free(file);
+    return NULL;
+}
+
+static void font_file_close(FontFile *file) {
+    FT_Done_Face(file->face);
+    munmap(file->map, file->map_len);
+    free(file->filename);
+    free(file);
+}
+
+static void font_file_unlink(FontFile *file) {
+    FontFile **p = &fonts.files;
+    while (*p != file) {
+        p = &(*p)->next;
+    }
+    *p = file->next;
+}
+
+// look up or load the face for filename and a size instance on it; reused is
+// set when the face was already loaded
+bool font_acquire(Font *font, const char *filename, size_t size, bool *reused)
 {
     bool ret = false;
-    if (FT_Init_FreeType(ft) == 0)
-    {
-        if (FT_New_Face(*ft, ttf_file, 0, face) == 0)
-        {
-            // Note -- req_size is a request, not an instruction
-            if (FT_Set_Pixel_Sizes(*face, 0, req_size) == 0)
-            {
-                ret = true;
-            }
-            else
-            {
-                perror("Can't set font size");
-                return false;
-            }
+    FontFile *file = NULL;
+    FontSize *sized = NULL;
+
+    pthread_mutex_lock(&fonts.mutex);
+
+    if (!fonts.ft && FT_Init_FreeType(&fonts.ft) != 0) {
+        perror("Can't initialize FreeType library");
+        goto done;
+    }
+
+    for (file = fonts.files; file; file = file->next) {
+        if (strcmp(file->filename, filename) == 0 && asset_unchanged(filename, &file->stamp)) {
+            break;
+        }
+    }
+
+    *reused = file != NULL;
+
+    if (!file) {
+        file = font_file_open(filename);
+        if (!file) {
+            goto done;
         }
-        else
-        {
-            perror("Can't load TTF file");
-            return false;
+        file->next = fonts.files;
+        fonts.files = file;
+    }
+
+    for (sized = file->sizes; sized; sized = sized->next) {
+        if (sized->px == size) {
+            break;
         }
     }
-    else
-    {
-        perror("Can't initialize FreeType library");
-        return false;
+
+    if (!sized) {
+        sized = calloc(1, sizeof(FontSize));
+        if (!sized) {
+            perror("Error: Memory allocation failed");
+            goto done;
+        }
+
+        // Note -- size is a request, not an instruction
+        if (FT_New_Size(file->face, &sized->size) != 0 || FT_Activate_Size(sized->size) != 0 ||
+            FT_Set_Pixel_Sizes(file->face, 0, size) != 0) {
+            perror("Can't set font size");
+            if (sized->size) {
+                FT_Done_Size(sized->size);
+            }
+            free(sized);
+            goto done;
+        }
+
+        sized->px = size;
+        sized->next = file->sizes;
+        file->sizes = sized;
     }
 
+    sized->refs++;
+    file->refs++;
+    font->file = file;
+    font->sized = sized;
+    ret = true;
+
+    done:
+    // drop a freshly opened file nothing ended up using
+    if (!ret && file && !file->refs) {
+        font_file_unlink(file);
+        font_file_close(file);
+    }
+
+    pthread_mutex_unlock(&fonts.mutex);
     return ret;
-}
\ No newline at end of file
+}
+
+void font_release(Font *font)
+{
+    if (!font->file) {
+        return;
+    }
+
+    pthread_mutex_lock(&fonts.mutex);
+
+    FontFile *file = font->file;
+    FontSize *sized = font->sized;
+
+    if (--sized->refs == 0) {
+        FontSize **p = &file->sizes;
+        while (*p != sized) {
+            p = &(*p)->next;
+        }
+        *p = sized->next;
+        FT_Done_Size(sized->size);
+        free(sized);
+    }
+
+    if (--file->refs == 0) {
+        font_file_unlink(file);
+        font_file_close(file);
+    }
+
+    font->file = NULL;
+    font->sized = NULL;
+
+    pthread_mutex_unlock(&fonts.mutex);
+}
+
+void font_manager_shutdown()
+{
+    pthread_mutex_lock(&fonts.mutex);
+
+    while (fonts.files) {
+        FontFile *file = fonts.files;
+        fonts.files = file->next;
+        font_file_close(file);
+    }
+
+    if (fonts.ft) {
+        FT_Done_FreeType(fonts.ft);
+        fonts.ft = NULL;
+    }
+
+    pthread_mutex_unlock(&fonts.mutex);
+}
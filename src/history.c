@@ -0,0 +1,135 @@
+#include "history.h"
+
+static const double history_spans[HISTORY_LEVELS] = {0, 10, 60, 600};
+
+int history_init(History *h, Arena *arena, size_t raw_capacity, double window) {
+    memset(h, 0, sizeof(History));
+
+    for (size_t i = 0; i < HISTORY_LEVELS; i++) {
+        double span = history_spans[i];
+        size_t capacity = raw_capacity;
+
+        // a rollup needs at least two buckets in the window to be of use
+        if (span) {
+            if (window < span * 2) {
+                break;
+            }
+            capacity = ceil(window / span) + 2;
+        }
+
+        if (capacity > HISTORY_LEVEL_MAX && span) {
+            capacity = HISTORY_LEVEL_MAX;
+        }
+
+        if (!capacity) {
+            break;
+        }
+
+        HistoryLevel *l = &h->levels[h->level_count];
+        l->ring = arena_alloc(arena, sizeof(Sample) * capacity);
+        if (l->ring == NULL) {
+            return -1;
+        }
+        l->span = span;
+        l->capacity = capacity;
+        h->level_count++;
+    }
+
+    return 0;
+}
+
+static void level_append(HistoryLevel *l, const Sample *s) {
+    l->head = l->count ? (l->head + 1) % l->capacity : 0;
+    l->ring[l->head] = *s;
+    if (l->count < l->capacity) {
+        l->count++;
+    }
+}
+
+// O(levels): append the raw sample, then fold it into the newest bucket of
+// each rollup or open a new one when it falls past the bucket's span
+void history_push(History *h, double value, double time) {
+    Sample s = {.time = time, .min = value, .max = value, .sum = value, .count = 1};
+
+    for (size_t i = 0; i < h->level_count; i++) {
+        HistoryLevel *l = &h->levels[i];
+
+        if (!l->span) {
+            level_append(l, &s);
+            continue;
+        }
+
+        Sample *b = &l->ring[l->head];
+        if (l->count && time >= b->time && time < b->time + l->span) {
+            b->min = value < b->min ? value : b->min;
+            b->max = value > b->max ? value : b->max;
+            b->sum += value;
+            b->count++;
+        } else {
+            Sample bucket = s;
+            bucket.time = floor(time / l->span) * l->span;
+            level_append(l, &bucket);
+        }
+    }
+}
+
+// copy the newest entries of every level the old history shares with this
+// one, as many as fit
+void history_adopt(History *h, const History *old) {
+    for (size_t i = 0; i < h->level_count; i++) {
+        HistoryLevel *l = &h->levels[i];
+
+        for (size_t j = 0; j < old->level_count; j++) {
+            const HistoryLevel *o = &old->levels[j];
+            if (o->span != l->span) {
+                continue;
+            }
+
+            size_t n = o->count < l->capacity ? o->count : l->capacity;
+            l->count = 0;
+            for (size_t k = n; k-- > 0;) {
+                level_append(l, history_at(o, k));
+            }
+            break;
+        }
+    }
+}
+
+// the finest level still holding everything since the given time, else the
+// coarsest
+const HistoryLevel *history_level_for(const History *h, double since) {
+    if (!h->level_count) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < h->level_count; i++) {
+        const HistoryLevel *l = &h->levels[i];
+        if (!l->count) {
+            continue;
+        }
+
+        const Sample *oldest = history_at(l, l->count - 1);
+        if (l->count < l->capacity || oldest->time <= since) {
+            return l;
+        }
+    }
+
+    return &h->levels[h->level_count - 1];
+}
+
+// number of entries, newest first, that end after the given time; rings are
+// filled in time order so this is a binary search rather than a scan
+size_t history_count_since(const HistoryLevel *l, double since) {
+    size_t lo = 0, hi = l->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (history_at(l, mid)->time + l->span > since) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
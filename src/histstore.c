@@ -0,0 +1,229 @@
+#include "histstore.h"
+
+static size_t store_size(size_t slot_count, size_t capacity) {
+    return sizeof(HistoryStoreHeader) + slot_count * sizeof(HistorySlot) + slot_count * capacity * sizeof(HistoryPoint);
+}
+
+// slots read back from the file are used only with a terminated identifier
+// and a head and count inside the ring: an unterminated identifier clears the
+// slot, a bad ring position only its points so probe chains stay intact;
+// slots_used is counted again. The number of slots cleared.
+static size_t store_check_slots(HistoryStore *store) {
+    uint32_t capacity = store->header->capacity;
+    size_t cleared = 0, used = 0;
+
+    for (size_t i = 0; i < store->header->slot_count; i++) {
+        HistorySlot *slot = &store->slots[i];
+
+        if (slot->identifier[HISTORY_IDENTIFIER_MAX - 1]) {
+            memset(slot, 0, sizeof(HistorySlot));
+            cleared++;
+        } else if (slot->head >= capacity || slot->count > capacity) {
+            slot->head = slot->count = 0;
+            cleared++;
+        }
+        used += slot->identifier[0] != '\0';
+    }
+
+    store->header->slots_used = used;
+    return cleared;
+}
+
+// map the store, creating or resetting it when missing or laid out for a
+// different number of slots or samples; the file is sparse until written
+HistoryStore *history_store_open(const char *filename, size_t slot_count, size_t capacity) {
+    struct stat st;
+    size_t len = store_size(slot_count, capacity);
+    bool reset = true;
+
+    HistoryStore *store = calloc(1, sizeof(HistoryStore));
+    if (store == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Could not open history file %s\n", filename);
+        goto cleanup;
+    }
+
+    if ((size_t)st.st_size == len) {
+        HistoryStoreHeader header;
+        if (pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == HISTORY_STORE_MAGIC &&
+            header.version == HISTORY_STORE_VERSION && header.slot_count == slot_count && header.capacity == capacity) {
+            reset = false;
+        }
+    }
+
+    if (reset) {
+        if (st.st_size) {
+            fprintf(stderr, "History file %s has a different layout, starting over\n", filename);
+        }
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, len) != 0) {
+            fprintf(stderr, "Error: Could not size history file %s\n", filename);
+            goto cleanup;
+        }
+    }
+
+    store->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (store->map == MAP_FAILED) {
+        store->map = NULL;
+        fprintf(stderr, "Error: Could not map history file %s\n", filename);
+        goto cleanup;
+    }
+    close(fd);
+    fd = -1;
+
+    store->filename = strdup(filename);
+    store->map_len = len;
+    store->header = (HistoryStoreHeader *)store->map;
+    store->slots = (HistorySlot *)(store->map + sizeof(HistoryStoreHeader));
+    store->points = (HistoryPoint *)(store->map + sizeof(HistoryStoreHeader) + slot_count * sizeof(HistorySlot));
+
+    if (reset) {
+        store->header->magic = HISTORY_STORE_MAGIC;
+        store->header->version = HISTORY_STORE_VERSION;
+        store->header->slot_count = slot_count;
+        store->header->capacity = capacity;
+    } else {
+        size_t cleared = store_check_slots(store);
+        if (cleared) {
+            fprintf(stderr, "History file %s had %zu damaged identifiers, cleared\n", filename, cleared);
+        }
+    }
+
+    printf("History file %s: %u/%u identifiers, %u samples each\n", filename,
+           store->header->slots_used, store->header->slot_count, store->header->capacity);
+    return store;
+
+    cleanup:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(store);
+    return NULL;
+}
+
+void history_store_close(HistoryStore *store) {
+    if (!store) {
+        return;
+    }
+
+    msync(store->map, store->map_len, MS_SYNC);
+    munmap(store->map, store->map_len);
+    free(store->filename);
+    free(store);
+}
+
+// find the slot of identifier or claim a free one; NULL when the table is
+// full or the identifier too long to store
+HistorySlot *history_store_slot(HistoryStore *store, const char *identifier) {
+    size_t slot_count = store->header->slot_count;
+    uint32_t hash = config_hash(identifier);
+
+    if (strlen(identifier) >= HISTORY_IDENTIFIER_MAX) {
+        return NULL;
+    }
+
+    for (size_t n = 0, i = hash % slot_count; n < slot_count; n++, i = (i + 1) % slot_count) {
+        HistorySlot *slot = &store->slots[i];
+
+        if (!slot->identifier[0]) {
+            // keep one slot free so lookups of unknown identifiers terminate early
+            if (store->header->slots_used + 1 >= slot_count) {
+                break;
+            }
+            strcpy(slot->identifier, identifier);
+            slot->hash = hash;
+            slot->head = slot->count = 0;
+            store->header->slots_used++;
+            return slot;
+        }
+
+        if (slot->hash == hash && strcmp(slot->identifier, identifier) == 0) {
+            return slot;
+        }
+    }
+
+    if (!store->full_reported) {
+        fprintf(stderr, "History file %s is full, raise history.identifiers\n", store->filename);
+        store->full_reported = true;
+    }
+    return NULL;
+}
+
+// replay what a graph shows: the window, or the samples it has room for
+static void replay_graph(HistoryStore *store, HistorySlot *slot, Widget *w) {
+    HistoryPoint *ring = history_store_ring(store, slot);
+    uint32_t capacity = store->header->capacity;
+    size_t n = slot->count;
+
+    if (!n || !w->history.level_count) {
+        return;
+    }
+
+    HistoryPoint *newest = &ring[slot->head];
+    if (w->window > 0) {
+        size_t k = 0;
+        while (k < n && ring[(slot->head + capacity - k) % capacity].time >= newest->time - w->window) {
+            k++;
+        }
+        n = k;
+    } else if (n > w->history.levels[0].capacity) {
+        n = w->history.levels[0].capacity;
+    }
+
+    for (size_t k = n; k-- > 0;) {
+        HistoryPoint *p = &ring[(slot->head + capacity - k) % capacity];
+        widget_log_push(w, p->value, p->time);
+    }
+}
+
+// point every widget with an identifier at its slot, and on startup fill
+// graphs and values from what was stored before
+void history_store_bind(HistoryStore *store, Config *config, bool replay) {
+    size_t restored = 0;
+
+    for (size_t i = 0; i < config->widget_count; i++) {
+        Widget *w = &config->widgets[i];
+        w->slot = NULL;
+
+        if (!store || !w->identifier) {
+            continue;
+        }
+
+        // a widget for one source keeps the history of that source alone
+        if (w->source) {
+            char key[HISTORY_IDENTIFIER_MAX * 2];
+            snprintf(key, sizeof(key), "%s|%s", w->source, w->identifier);
+            w->slot = history_store_slot(store, key);
+        } else {
+            w->slot = history_store_slot(store, w->identifier);
+        }
+        if (!w->slot || !replay || !w->slot->count) {
+            continue;
+        }
+
+        if (config->hot.kind[i] == WIDGET_GRAPH) {
+            replay_graph(store, w->slot, w);
+        }
+        config->hot.value[i] = history_store_ring(store, w->slot)[w->slot->head].value;
+        config->hot.updated[i] = history_store_ring(store, w->slot)[w->slot->head].time;
+        config->hot.dirty[i] = 1;
+        restored++;
+    }
+
+    if (replay && store) {
+        printf("Restored %zu widgets from %s\n", restored, store->filename);
+    }
+}
+
+void history_store_sync(HistoryStore *store, double now) {
+    if (!store || now - store->synced < HISTORY_STORE_SYNC_SECONDS) {
+        return;
+    }
+
+    msync(store->map, store->map_len, MS_ASYNC);
+    store->synced = now;
+}
@@ -0,0 +1,200 @@
+#include "imgcache.h"
+
+// cache directory: $RTOP_CACHE_DIR, else $XDG_CACHE_HOME/rtop, else ~/.cache/rtop
+static bool cache_dir(char *dir, size_t len) {
+    const char *env = getenv(IMAGE_CACHE_DIR_ENV);
+    if (env && *env) {
+        snprintf(dir, len, "%s", env);
+        return true;
+    }
+
+    env = getenv("XDG_CACHE_HOME");
+    if (env && *env) {
+        snprintf(dir, len, "%s/rtop", env);
+        return true;
+    }
+
+    env = getenv("HOME");
+    if (env && *env) {
+        snprintf(dir, len, "%s/.cache/rtop", env);
+        return true;
+    }
+
+    return false;
+}
+
+static bool cache_path(uint64_t hash, const PixelFormat *fmt, char *path, size_t len) {
+    char dir[512];
+
+    if (!cache_dir(dir, sizeof(dir))) {
+        return false;
+    }
+
+    snprintf(path, len, "%s/%016" PRIx64 "-%s.img", dir, hash, fmt->name);
+    return true;
+}
+
+static uint64_t hash_bytes(const uint8_t *data, size_t len) {
+    const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = len * m;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, data + i, sizeof(k));
+        k *= m;
+        k ^= k >> 32;
+        h = (h ^ k) * m;
+    }
+
+    for (; i < len; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+
+    h ^= h >> 29;
+    h *= m;
+    h ^= h >> 32;
+    return h;
+}
+
+// hash of the source file contents, which is what cached images are keyed by
+bool image_cache_key(const char *filename, uint64_t *hash) {
+    bool ret = false;
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            *hash = hash_bytes(map, st.st_size);
+            munmap(map, st.st_size);
+            ret = true;
+        }
+    }
+
+    close(fd);
+    return ret;
+}
+
+// map a cached image straight into png, no copy or conversion
+int image_cache_load(uint64_t hash, const PixelFormat *fmt, Png *png) {
+    char path[768];
+    struct stat st;
+    int fd;
+
+    if (!cache_path(hash, fmt, path, sizeof(path))) {
+        return -1;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ImageCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    ImageCacheHeader *header = (ImageCacheHeader *)map;
+    size_t pixels = (size_t)header->width * header->height;
+    size_t expected = header->data_offset + pixels * fmt->Bpp + (header->has_alpha ? pixels : 0);
+
+    if (header->magic != IMAGE_CACHE_MAGIC || header->version != IMAGE_CACHE_VERSION || header->hash != hash ||
+        strncmp(header->format, fmt->name, sizeof(header->format)) != 0 || header->data_offset < sizeof(ImageCacheHeader) ||
+        expected != (size_t)st.st_size) {
+        fprintf(stderr, "Ignoring stale image cache %s\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    png->map = map;
+    png->map_len = st.st_size;
+    png->data = map + header->data_offset;
+    png->alpha = header->has_alpha ? png->data + pixels * fmt->Bpp : NULL;
+    png->width = header->width;
+    png->height = header->height;
+    png->size = pixels * fmt->Bpp;
+    return 0;
+}
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    while (len) {
+        ssize_t written = write(fd, p, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+// write a decoded image to the cache; written to a temporary file and renamed
+// so a concurrent or interrupted writer never leaves a partial entry behind
+void image_cache_store(uint64_t hash, const PixelFormat *fmt, const Png *png) {
+    char dir[512], path[768], tmp[800];
+    size_t pixels = png->width * png->height;
+
+    if (!cache_dir(dir, sizeof(dir)) || !cache_path(hash, fmt, path, sizeof(path))) {
+        return;
+    }
+
+    // create the directory and its parent (~/.cache) if needed
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+        *slash = '/';
+    }
+    mkdir(dir, 0755);
+
+    // asset pool threads may store the same image at once, each needs its own
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd < 0 || fchmod(fd, 0644) != 0) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        fprintf(stderr, "Unable to write image cache %s\n", tmp);
+        return;
+    }
+
+    ImageCacheHeader header = {
+        .magic = IMAGE_CACHE_MAGIC,
+        .version = IMAGE_CACHE_VERSION,
+        .hash = hash,
+        .width = png->width,
+        .height = png->height,
+        .has_alpha = png->alpha != NULL,
+        .data_offset = sizeof(ImageCacheHeader),
+    };
+    strncpy(header.format, fmt->name, sizeof(header.format) - 1);
+
+    bool ok = write_all(fd, &header, sizeof(header)) && write_all(fd, png->data, pixels * fmt->Bpp) &&
+              (!png->alpha || write_all(fd, png->alpha, pixels));
+
+    close(fd);
+
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Unable to write image cache %s\n", path);
+        unlink(tmp);
+    }
+}
@@ -0,0 +1,407 @@
+#include "ingest.h"
+
+static inline void source_add(_Atomic uint64_t *counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// listener number listener of listeners, queueing packets for the render loop
+Ingest *ingest_open(size_t listener, size_t listeners) {
+    // too big for the stack, holds the source table; the queue indices are
+    // cache line aligned
+    Ingest *in = aligned_alloc(alignof(Ingest), sizeof(Ingest));
+    if (in == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    memset(in, 0, sizeof(Ingest));
+    in->listener = listener;
+    in->listeners = listeners;
+    if (listeners > 1) {
+        snprintf(in->name, sizeof(in->name), "listener %zu", listener);
+    } else {
+        strcpy(in->name, "listener");
+    }
+    pthread_mutex_init(&in->sources_mutex, NULL);
+    return in;
+}
+
+// the sender of a packet, added the first time it is seen; NULL if there is
+// no inflate state for it
+static IngestSource *ingest_source(Ingest *in, const PacketHeader *h, const struct sockaddr_in *from, uint64_t now) {
+    bool has_host_id = h->flags & PACKET_HOST_ID;
+    IngestSource *oldest = NULL, *s;
+
+    for (size_t i = 0; i < in->source_count; i++) {
+        s = &in->sources[i];
+        if (s->has_host_id == has_host_id && (has_host_id ? s->host_id == h->host_id : s->addr == from->sin_addr.s_addr)) {
+            return s;
+        }
+        if (!oldest || s->last_seen < oldest->last_seen) {
+            oldest = s;
+        }
+    }
+
+    pthread_mutex_lock(&in->sources_mutex);
+    if (in->source_count < INGEST_SOURCES_MAX) {
+        s = &in->sources[in->source_count];
+        memset(s, 0, sizeof(IngestSource));
+        if (inflateInit2(&s->stream, -15) != Z_OK) {
+            pthread_mutex_unlock(&in->sources_mutex);
+            fprintf(stderr, "inflateInit2 failed\n");
+            return NULL;
+        }
+        in->source_count++;
+    } else {
+        // its inflate state is reset for every packet anyway
+        s = oldest;
+        printf("Forgetting source %s, idle for %.0f s\n", s->name, (now - s->last_seen) / 1e9);
+    }
+
+    s->has_host_id = has_host_id;
+    s->host_id = h->host_id;
+    s->addr = from->sin_addr.s_addr;
+    s->has_seq = false;
+    s->has_timestamp = false;
+    s->timestamp = 0;
+    s->packets = s->lost = s->duplicates = s->reordered = 0;
+    if (has_host_id) {
+        snprintf(s->name, sizeof(s->name), "%u", h->host_id);
+    } else {
+        inet_ntop(AF_INET, &from->sin_addr, s->name, sizeof(s->name));
+    }
+    pthread_mutex_unlock(&in->sources_mutex);
+
+    printf("New source %s\n", s->name);
+    return s;
+}
+
+// count the sequence numbers pushed out of the seen window by a packet
+// ahead numbers past the newest, and move the window up to it
+static void ingest_advance(IngestSource *s, uint32_t ahead) {
+    uint64_t leaving = ahead < 64 ? s->seen >> (64 - ahead) : s->seen;
+    uint64_t lost = (ahead < 64 ? ahead : 64) - __builtin_popcountll(leaving) + (ahead > 64 ? ahead - 64 : 0);
+
+    if (lost) {
+        source_add(&s->lost, lost);
+        stats_add(STAT_LOST, lost);
+    }
+    s->seen = (ahead < 64 ? s->seen << ahead : 0) | 1;
+}
+
+// whether a packet is newer than every one taken from its source. Repeats
+// and packets overtaken by a newer one are rejected, the latter still
+// counting as arrived if they are within the seen window; packets without
+// either field are always taken. A packet that is not newer is taken as a
+// restart of the sender if it comes after a silence (idle) or, with a
+// sequence number, is too far behind for the seen window.
+static bool ingest_sequence(IngestSource *s, const PacketHeader *h, bool idle) {
+    if (h->flags & PACKET_SEQ) {
+        int32_t ahead = (int32_t)(h->seq - s->seq);
+        uint32_t behind = -(int64_t)ahead;
+
+        if (!s->has_seq || (ahead <= 0 && (idle || behind >= 64))) {
+            s->has_seq = true;
+            s->seq = h->seq;
+            s->seen = ~0ULL;
+            return true;
+        }
+
+        if (ahead > 0) {
+            ingest_advance(s, ahead);
+            s->seq = h->seq;
+            return true;
+        }
+
+        if (behind < 64 && (s->seen >> behind) & 1) {
+            source_add(&s->duplicates, 1);
+            stats_add(STAT_DUPLICATES, 1);
+            return false;
+        }
+        if (behind < 64) {
+            s->seen |= 1ULL << behind;
+        }
+        source_add(&s->reordered, 1);
+        stats_add(STAT_REORDERED, 1);
+        return false;
+    } else if (h->flags & PACKET_TIMESTAMP) {
+        // the first packet is taken whatever its timestamp, even 0
+        bool restart = !s->has_timestamp || idle;
+
+        if (!restart && h->timestamp == s->timestamp) {
+            source_add(&s->duplicates, 1);
+            stats_add(STAT_DUPLICATES, 1);
+            return false;
+        }
+        if (!restart && h->timestamp < s->timestamp) {
+            source_add(&s->reordered, 1);
+            stats_add(STAT_REORDERED, 1);
+            return false;
+        }
+        s->has_timestamp = true;
+        s->timestamp = h->timestamp;
+    }
+
+    return true;
+}
+
+// listener: check the crc of a received packet, record it and inflate its
+// payload straight into a queue slot for the render loop; false if it was
+// dropped
+bool ingest_packet(Ingest *in, const uint8_t *packet, size_t length, const struct sockaddr_in *from) {
+    PacketTrace trace = {0};
+    PacketHeader h;
+    struct timespec received_at;
+    uint32_t received_crc;
+
+    trace.received = stats_ns();
+
+    // stamped with when it arrived
+    clock_gettime(CLOCK_REALTIME, &received_at);
+
+    if (!packet_parse(packet, length, &h)) {
+        return false;
+    }
+
+    const uint8_t *payload = packet + h.payload;
+
+    memcpy(&received_crc, payload + h.payload_length, sizeof(received_crc));
+    uint32_t computed_crc = _crc32(packet + HEADER_SIZE, h.size - HEADER_SIZE - CRC32_SIZE);
+
+    if (received_crc != computed_crc) {
+        fprintf(stderr, "CRC mismatch (%x != %x), dropping\n", received_crc, computed_crc);
+        stats_add(STAT_CRC_ERRORS, 1);
+        return false;
+    }
+    trace.checked = stats_ns();
+    stats_time(STAGE_CRC, trace.checked - trace.received);
+
+    if (in->capture) {
+        capture_write(in->capture, packet, h.size, received_at.tv_sec * 1000000000ULL + received_at.tv_nsec, from);
+    }
+
+    IngestSource *source = ingest_source(in, &h, from, trace.received);
+    if (source == NULL) {
+        stats_add(STAT_DROPPED, 1);
+        return false;
+    }
+    uint64_t idle = trace.received - atomic_load_explicit(&source->last_seen, memory_order_relaxed);
+    atomic_store_explicit(&source->last_seen, trace.received, memory_order_relaxed);
+
+    if (!ingest_sequence(source, &h, idle > INGEST_RESTART_NS)) {
+        return false;
+    }
+    source_add(&source->packets, 1);
+    stats_add(STAT_PACKETS, 1);
+
+    // the render loop has fallen too far behind, nothing is inflated
+    SharedPacket *shared = shared_queue_reserve(&in->queue, in->wait);
+    if (shared == NULL) {
+        stats_add(STAT_DROPPED, 1);
+        return false;
+    }
+
+    // decompress packet, leaving room for the terminator
+    size_t decompressed_length = shared->capacity - 1;
+    inflate_packet(&source->stream, payload, h.payload_length, (uint8_t *)shared->buffer, &decompressed_length);
+    trace.inflated = stats_ns();
+    stats_time(STAGE_INFLATE, trace.inflated - trace.checked);
+    if (!decompressed_length) {
+        stats_add(STAT_DROPPED, 1);
+        return false;
+    }
+
+    // hand the slot to the main thread
+    shared->buffer[decompressed_length] = '\0';
+    shared->size = decompressed_length;
+    shared->received = received_at.tv_sec + received_at.tv_nsec / 1e9;
+    memcpy(shared->source, source->name, sizeof(shared->source));
+    trace.seq = in->seq++;
+    trace.handed_off = stats_ns();
+    shared->trace = trace;
+    shared_queue_commit(&in->queue);
+
+    return true;
+}
+
+// render loop: the queue of the next listener with a packet waiting, going
+// round the listeners from *next so none is starved; NULL if all are empty
+SharedQueue *ingest_next(Ingest **ingests, size_t count, size_t *next) {
+    for (size_t i = 0; i < count; i++) {
+        Ingest *in = ingests[(*next + i) % count];
+        if (shared_queue_peek(&in->queue)) {
+            *next = (*next + i + 1) % count;
+            return &in->queue;
+        }
+    }
+    return NULL;
+}
+
+// the parser asks for the whole document in one allocation, which is all the
+// copying a payload sees after inflate
+static void *ingest_parse_alloc(void *user_data, size_t size) {
+    IngestParse *p = user_data;
+
+    if (p->capacity < size) {
+        free(p->data);
+        p->data = malloc(size);
+        p->capacity = p->data ? size : 0;
+    }
+    stats_add(STAT_COPY_BYTES, size);
+    return p->data;
+}
+
+// render loop: parse a payload into the reused buffer, valid until the next
+// call; NULL if it is not json
+struct json_value_s *ingest_parse(IngestParse *p, const char *payload, size_t size) {
+    return json_parse_ex(payload, size, json_parse_flags_default, ingest_parse_alloc, p, NULL);
+}
+
+void ingest_parse_free(IngestParse *p) {
+    free(p->data);
+    p->data = NULL;
+    p->capacity = 0;
+}
+
+// after the listener or replay thread has been joined
+void ingest_close(Ingest *in) {
+    if (in == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < in->source_count; i++) {
+        inflateEnd(&in->sources[i].stream);
+    }
+    shared_queue_free(&in->queue);
+    pthread_mutex_destroy(&in->sources_mutex);
+    free(in);
+}
+
+// render loop: push the values of a parsed packet into every widget showing
+// its identifiers from its source and into the history store; the number of
+// widgets updated
+size_t ingest_route(Config *config, HistoryStore *history, struct json_value_s *root, double received, const char *source) {
+    size_t shown = 0;
+
+    struct json_object_s *obj = json_value_as_object(root);
+    if (!obj) {
+        fprintf(stderr, "JSON root object parsing failure\n");
+        return 0;
+    }
+
+    struct json_object_element_s *elem = obj->start;
+    while (elem != NULL) {
+        if (elem->value->type == json_type_object) {
+            // check to see if we care about this identifier
+            Widget *first = config_find_widget(config, elem->name->string);
+            // widgets for any source and for this one keep separate histories
+            HistorySlot *persisted = NULL, *persisted_source = NULL;
+            for (Widget *w = first; w; w = w->next_same) {
+                if (!widget_shows_source(w, source)) {
+                    continue;
+                }
+                struct json_object_s *obj2 = json_value_as_object(elem->value);
+                if (!obj2) {
+                    fprintf(stderr, "JSON object value parsing failure\n");
+                    continue;
+                }
+                struct json_object_element_s *elem2 = obj2->start;
+                while (elem2 != NULL) {
+                    if (strcmp(elem2->name->string, "Value") == 0) {
+                        struct json_number_s *value = json_value_as_number(elem2->value);
+                        if (!value) {
+                            fprintf(stderr, "JSON number value parsing failure\n");
+                            elem2 = elem2->next;
+                            continue;
+                        }
+                        double num_value = strtod(value->number, NULL);
+
+                        // persist once per identifier and source
+                        HistorySlot **persisted_by = w->source ? &persisted_source : &persisted;
+                        if (w->slot && *persisted_by != w->slot) {
+                            history_store_append(history, w->slot, received, num_value);
+                            *persisted_by = w->slot;
+                        }
+
+                        // if its a graph, push the new value
+                        size_t i = w - config->widgets;
+                        if (config->hot.kind[i] == WIDGET_GRAPH) {
+                            widget_log_push(w, num_value, received);
+                            config->hot.updated[i] = received;
+                            config->hot.dirty[i] = 1;
+                            shown++;
+                        }
+
+                        else if (config->hot.kind[i] == WIDGET_VALUE) {
+                            config->hot.value[i] = num_value;
+                            config->hot.updated[i] = received;
+                            config->hot.dirty[i] = 1;
+                            shown++;
+                        }
+                    }
+                    elem2 = elem2->next;
+                }
+            }
+        }
+        elem = elem->next;
+    }
+
+    return shown;
+}
+
+// sleep until the monotonic ns deadline, waking up to notice a shutdown
+static void replay_sleep_until(uint64_t deadline) {
+    for (uint64_t now = stats_ns(); running && now < deadline; now = stats_ns()) {
+        uint64_t ns = deadline - now;
+        if (ns > 100000000ULL) {
+            ns = 100000000ULL;
+        }
+        struct timespec ts = {.tv_sec = 0, .tv_nsec = ns};
+        nanosleep(&ts, NULL);
+    }
+}
+
+void *capture_replay(void *arg) {
+    Replay *r = arg;
+    struct sockaddr_in from;
+    StatsTotals totals;
+    uint64_t first = 0, time_ns = 0;
+    size_t length = 0, packets = 0;
+
+    stats_register("replay");
+
+    uint8_t *packet = malloc(BUFFER_SIZE);
+    if (packet == NULL) {
+        perror("Error: Memory allocation failed");
+        running = false;
+        return NULL;
+    }
+
+    r->ingest->wait = r->fast;
+    uint64_t start = stats_ns();
+
+    while (running && capture_read(r->capture, packet, BUFFER_SIZE, &length, &time_ns, &from) > 0) {
+        // keep the gaps between packets, a clock step back replays at once
+        if (!r->fast) {
+            if (!packets) {
+                first = time_ns;
+            }
+            replay_sleep_until(start + (time_ns > first ? time_ns - first : 0));
+        }
+        packets++;
+
+        ingest_packet(r->ingest, packet, length, &from);
+    }
+
+    // done once the render loop has taken the last packet
+    shared_queue_drain(&r->ingest->queue);
+
+    double elapsed = (stats_ns() - start) / 1e9;
+    stats_collect(&totals);
+    printf("Replayed %zu packets in %.3f s, %.0f packets/s, %" PRIu64 " dropped\n", packets, elapsed,
+           elapsed > 0 ? packets / elapsed : 0, totals.counters[STAT_DROPPED] + totals.counters[STAT_CRC_ERRORS]);
+
+    free(packet);
+    running = false;
+    return NULL;
+}
@@ -16,158 +16,390 @@ volatile bool running = true;
 #include "sock.h"
 #include "shared.h"
 #include "json.h"
+#include "reload.h"
+#include "snapshot.h"
+#include "histstore.h"
+#include "stats.h"
+#include "export.h"
+#include "trace.h"
+#include "ingest.h"
+#include "capture.h"
 
+#define CONFIG_FILE "config.json"
+#define CONFIG_SNAPSHOT "config.bin"
 #define TARGET_FPS 60
 #define FRAME_TIME (1.0 / TARGET_FPS)
+#define HEADLESS_WIDTH 1920
+#define HEADLESS_HEIGHT 1080
 
 void handle_sigint(int sig) {
     printf("\nCaught signal %d (Ctrl+C). Exiting!\n", sig);
     running = false;
 }
 
-int main() {
+// composite everything that never changes after load into the background layer
+void draw_background(Config *config, FrameBuffer *fb) {
+    fb_clear(fb);
+
+    for (size_t i = 0; i < config->widget_count; i++) {
+        widget_draw_static(&config->widgets[i], fb);
+    }
+
+    fb_save_background(fb);
+}
+
+int main(int argc, char **argv) {
     int ret = EXIT_FAILURE;
     FrameBuffer *fb = NULL;   
     struct timespec start, end, sleep_time;
-    char fps_text[32] = {0};
-    pthread_t listener_thread = 0;
+    StatsReport report = {0};
+    uint64_t upload_bytes = 0, upload_ns = 0;
+    pthread_t listener_threads[INGEST_LISTENERS_MAX] = {0};
+    pthread_t replay_thread = 0;
+    pthread_t watcher_thread = 0;
+    pthread_t export_thread = 0;
+    Exporter *exporter = NULL;
+    TraceLog *trace_log = NULL;
+    const char *trace_file = NULL, *record_file = NULL, *replay_file = NULL;
+    double trace_seconds = TRACE_SECONDS;
+    bool headless = false;
+    Replay replay = {0};
+    // routed packets waiting for the frame that shows them
+    PacketTrace pending[SHARED_QUEUE_PACKETS * INGEST_LISTENERS_MAX];
+    size_t pending_count = 0;
+    SharedQueue *queue;
+    IngestParse parse = {0};
+    HistoryStore *history = NULL;
+    struct timespec wall;
+    double received = 0, drawn_now = 0;
 
     Config config = {0};
 
-    // shared buffer
-    SharedBuffer shared_data = {
-        .data_available = false,
-        .mutex = PTHREAD_MUTEX_INITIALIZER,
-        .cond = PTHREAD_COND_INITIALIZER
+    Reloader reloader = {
+        .filename = CONFIG_FILE,
+        .live = &config,
+        .mutex = PTHREAD_MUTEX_INITIALIZER
     };
 
-    signal(SIGINT, handle_sigint);
+    // one per listener thread, each with its queue of packets
+    Ingest *ingests[INGEST_LISTENERS_MAX] = {0};
+    size_t listeners = 1, next_listener = 0;
+    IngestReceive receive = INGEST_RECEIVE_URING;
+
+    // rtop --compile-config [config.json [config.bin]]
+    if (argc > 1 && strcmp(argv[1], "--compile-config") == 0) {
+        ret = compile_config(argc > 2 ? argv[2] : CONFIG_FILE, argc > 3 ? argv[3] : CONFIG_SNAPSHOT);
+        font_manager_shutdown();
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // rtop [--trace trace.json [seconds]] [--record capture] [--replay capture [--fast]] [--headless]
+    //      [--listeners n] [--receive io_uring|recvfrom]
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                trace_seconds = atof(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_file = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if (strcmp(argv[i], "--fast") == 0) {
+            replay.fast = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--listeners") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 &&
+                   atoi(argv[i + 1]) <= INGEST_LISTENERS_MAX) {
+            listeners = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--receive") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "io_uring") == 0 || strcmp(argv[i + 1], "recvfrom") == 0)) {
+            receive = strcmp(argv[++i], "io_uring") == 0 ? INGEST_RECEIVE_URING : INGEST_RECEIVE_RECVFROM;
+        } else {
+            fprintf(stderr, "Usage: %s [--trace trace.json [seconds]] [--record capture] [--replay capture [--fast]] [--headless]\n"
+                            "       %*s [--listeners 1-%d] [--receive io_uring|recvfrom]\n"
+                            "       %s --compile-config [config.json [config.bin]]\n", argv[0], (int)strlen(argv[0]), "",
+                    INGEST_LISTENERS_MAX, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a capture is replayed by a single thread
+    if (replay_file) {
+        listeners = 1;
+    }
+
+    for (size_t i = 0; i < listeners; i++) {
+        ingests[i] = ingest_open(i, listeners);
+        if (ingests[i] == NULL) {
+            goto cleanup;
+        }
+        ingests[i]->receive = receive;
+    }
 
-    // load config
-    if (!load_config("config.json", &config) == 0) {
+    if (trace_file) {
+        trace_log = trace_open(trace_file, trace_seconds);
+    }
+
+    if (record_file && (ingests[0]->capture = capture_open(record_file, true)) == NULL) {
         goto cleanup;
     }
-    printf("Loaded: %ld\n", config.widget_count);
- 
-    // setup framebuffer
-    fb = fb_init();
+    for (size_t i = 1; i < listeners; i++) {
+        ingests[i]->capture = ingests[0]->capture;
+    }
+
+    if (replay_file && (replay.capture = capture_open(replay_file, false)) == NULL) {
+        goto cleanup;
+    }
+    replay.ingest = ingests[0];
+
+    signal(SIGINT, handle_sigint);
+    stats_register("render");
+
+    // setup framebuffer, colors and images are converted to its pixel format on load
+    // or an in-memory one, for replaying captures where there is no display
+    fb = headless ? fb_init_headless(HEADLESS_WIDTH, HEADLESS_HEIGHT, &pixel_format_xrgb8888) : fb_init();
     if (fb == NULL) {
         goto cleanup;
     }
 
-    // start socket thread
-    if (pthread_create(&listener_thread, NULL, udp_listener, &shared_data) != 0) {
-        perror("Failed to create listener thread");
+    // load config, from the compiled snapshot if it is up to date
+    if (load_config_snapshot(CONFIG_SNAPSHOT, CONFIG_FILE, &config, fb->fmt) != 0 &&
+        load_config(CONFIG_FILE, &config, fb->fmt, NULL) != 0) {
         goto cleanup;
     }
+    printf("Loaded: %ld\n", config.widget_count);
+
+    // re-attach to the history of the previous run
+    if (config.history_file) {
+        history = history_store_open(config.history_file, config.history_slots, config.history_samples);
+        history_store_bind(history, &config, true);
+    }
+
+    // serve stats to local scrapers
+    if (config.export_socket || config.export_port) {
+        exporter = exporter_open(config.export_socket, config.export_port, ingests, listeners);
+        if (exporter && pthread_create(&export_thread, NULL, stats_exporter, exporter) != 0) {
+            perror("Failed to create stats export thread");
+            export_thread = 0;
+        }
+    }
+
+    draw_background(&config, fb);
+
+    // watch the config for changes
+    reloader.fmt = fb->fmt;
+    if (pthread_create(&watcher_thread, NULL, config_watcher, &reloader) != 0) {
+        perror("Failed to create config watcher thread");
+        watcher_thread = 0;
+    }
+
+    // start socket threads, or feed the capture in their place
+    if (replay.capture) {
+        if (pthread_create(&replay_thread, NULL, capture_replay, &replay) != 0) {
+            perror("Failed to create replay thread");
+            goto cleanup;
+        }
+    } else {
+        for (size_t i = 0; i < listeners; i++) {
+            if (pthread_create(&listener_threads[i], NULL, udp_listener, ingests[i]) != 0) {
+                perror("Failed to create listener thread");
+                goto cleanup;
+            }
+        }
+    }
     // TODO make sure thread is running still
 
     struct json_value_s *root;
+    bool redraw = true;
 
     while (running) {
         clock_gettime(CLOCK_MONOTONIC, &start);
+        clock_gettime(CLOCK_REALTIME, &wall);
+        double now = wall.tv_sec + wall.tv_nsec / 1e9;
+
+        // swap in a reloaded config between frames
+        if (reloader_apply(&reloader, &config)) {
+            history_store_bind(history, &config, false);
+            draw_background(&config, fb);
+            redraw = true;
+        }
 
-        // new data available
-        if (shared_data.data_available) {
-            pthread_mutex_lock(&shared_data.mutex);
-            shared_data.data_available = false;
-            root = json_parse(shared_data.buffer, shared_data.size);
-            pthread_mutex_unlock(&shared_data.mutex);
+        // take every packet queued since the last frame, at most a queue's
+        // worth from each listener so a flood cannot hold up the frame
+        for (size_t n = 0; n < SHARED_QUEUE_PACKETS * listeners && (queue = ingest_next(ingests, listeners, &next_listener)); n++) {
+            // read in place from the slot the listener inflated it into
+            SharedPacket *packet = shared_queue_peek(queue);
+            uint64_t parse_start = stats_ns();
+            root = ingest_parse(&parse, packet->buffer, packet->size);
+            received = packet->received;
+            PacketTrace trace = packet->trace;
+            uint64_t route_start = stats_ns();
+            stats_add(STAT_PARSED, 1);
+            stats_time(STAGE_PARSE, route_start - parse_start);
+            trace.picked_up = parse_start;
+            trace.parsed = route_start;
 
             if (!root) {
                 fprintf(stderr, "JSON root parsing failure\n");
+                shared_queue_release(queue);
                 continue;
             }
 
-            struct json_object_s *obj = json_value_as_object(root);
-            if (!obj) {
-                fprintf(stderr, "JSON root object parsing failure\n");
-                continue;
+            bool shows = ingest_route(&config, history, root, received, packet->source) > 0;
+            shared_queue_release(queue);
+            trace.routed = stats_ns();
+            stats_time(STAGE_ROUTE, trace.routed - route_start);
+
+            // a packet nothing shows is done, otherwise it waits for the swap
+            if (shows && pending_count < sizeof(pending) / sizeof(pending[0])) {
+                pending[pending_count++] = trace;
+            } else {
+                trace_packet(trace_log, &trace);
+            }
+        }
+
+        history_store_sync(history, now);
+
+        // window graphs scroll with the clock even without new samples, and
+        // graphs and values turn grey once their sender goes quiet
+        for (size_t i = 0; i < config.widget_count; i++) {
+            if (config.hot.kind[i] == WIDGET_GRAPH && widget_scrolled(&config.widgets[i], drawn_now, now)) {
+                config.hot.dirty[i] = 1;
             }
+            if (config.hot.kind[i] == WIDGET_GRAPH || config.hot.kind[i] == WIDGET_VALUE) {
+                uint8_t stale = widget_stale(&config.widgets[i], config.hot.updated[i], now);
+                config.hot.dirty[i] |= stale != config.hot.stale[i];
+                config.hot.stale[i] = stale;
+            }
+        }
 
-            struct json_object_element_s *elem = obj->start;
-            while (elem != NULL) {
-                if (elem->value->type == json_type_object) {
-                    // check to see if we care about this identifier
-                    for (size_t i = 0; i < config.widget_count; i++) {
-                        if (config.widgets[i].identifier != NULL && strcmp(elem->name->string, config.widgets[i].identifier) == 0) {
-                            struct json_object_s *obj2 = json_value_as_object(elem->value);
-                            if (!obj2) {
-                                fprintf(stderr, "JSON object value parsing failure\n");
-                                continue;
-                            }
-                            struct json_object_element_s *elem2 = obj2->start;
-                            while (elem2 != NULL) {
-                                if (strcmp(elem2->name->string, "Value") == 0) {
-                                    struct json_number_s *value = json_value_as_number(elem2->value);
-                                    if (!value) {
-                                        fprintf(stderr, "JSON number value parsing failure\n");
-                                        elem2 = elem2->next;
-                                        continue;
-                                    }
-                                    double num_value = strtod(value->number, NULL);
-
-                                    // if its a graph, push the new value
-                                    if (strcmp(config.widgets[i].type, "graph") == 0) {
-                                        widget_log_push(&config.widgets[i], num_value);
-                                    }
-
-                                    else if (strcmp(config.widgets[i].type, "value") == 0) {
-                                        config.widgets[i].value = num_value;
-                                    }
-                                }
-                                elem2 = elem2->next;
-                            }
-                        }
-                    }
+        // refresh the stats widgets once a second, naming the widget that
+        // took longest to draw since the last report
+        if (stats_report_due(&report, now)) {
+            size_t slowest = 0;
+            for (size_t i = 0; i < config.widget_count; i++) {
+                if (config.hot.draw_ns[i] > config.hot.draw_ns[slowest]) {
+                    slowest = i;
+                }
+                if (config.hot.kind[i] == WIDGET_STATS) {
+                    config.hot.dirty[i] = 1;
                 }
-                elem = elem->next;
             }
-            free(root);
+
+            Widget *w = config.widget_count ? &config.widgets[slowest] : NULL;
+            stats_report_update(&report, now, w ? (w->identifier ? w->identifier : w->type) : NULL, w ? config.hot.draw_ns[slowest] : 0);
+            memset(config.hot.draw_ns, 0, sizeof(uint64_t) * config.widget_count);
+            exporter_publish(exporter, &config);
         }
 
-        // drawing
-        fb_clear(fb);
+        // the last frame is still current unless a widget changed
+        redraw |= memchr(config.hot.dirty, 1, config.widget_count) != NULL;
 
-        // draw fps string
-        ft_draw_string(config.fonts[0].face, fb, fps_text, 360, 680, rgb_to_rgb565(0xff,0xff,0xff));
+        if (redraw) {
+            uint64_t draw_start = stats_ns();
 
-        // draw graphs
-        for (size_t i = 0; i < config.widget_count; i++) {
-            widget_draw(&config.widgets[i], fb);
+            // drawing
+            fb_restore_background(fb);
+
+            // draw graphs, values and stats
+            for (size_t i = 0; i < config.widget_count; i++) {
+                uint64_t widget_start = stats_ns();
+
+                if (config.hot.kind[i] == WIDGET_GRAPH || config.hot.kind[i] == WIDGET_VALUE) {
+                    widget_draw(&config.widgets[i], config.hot.value[i], now, config.hot.stale[i], fb);
+                } else if (config.hot.kind[i] == WIDGET_STATS) {
+                    widget_draw_lines(&config.widgets[i], report.text, fb);
+                } else {
+                    continue;
+                }
+                config.hot.draw_ns[i] += stats_ns() - widget_start;
+            }
+            memset(config.hot.dirty, 0, config.widget_count);
+            drawn_now = now;
+
+            // swap buffers
+            uint64_t swap_start = stats_ns();
+            fb_swap(fb);
+            redraw = false;
+
+            stats_time(STAGE_DRAW, swap_start - draw_start);
+            stats_time(STAGE_SWAP, stats_ns() - swap_start);
+            stats_add(STAT_REDRAWS, 1);
+
+            uint64_t shown = stats_ns();
+            for (size_t i = 0; i < pending_count; i++) {
+                pending[i].shown = shown;
+                trace_packet(trace_log, &pending[i]);
+            }
+            pending_count = 0;
         }
 
-        // swap buffers
-        fb_swap(fb);
+        // upload throughput of the damaged rows
+        stats_add(STAT_UPLOAD_BYTES, fb->upload_bytes - upload_bytes);
+        stats_add(STAT_UPLOAD_NS, fb->upload_ns - upload_ns);
+        upload_bytes = fb->upload_bytes;
+        upload_ns = fb->upload_ns;
 
         // maintain framerate
         clock_gettime(CLOCK_MONOTONIC, &end);
         double frame_elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-        if (frame_elapsed < FRAME_TIME) {
+        stats_add(STAT_FRAMES, 1);
+        stats_time(STAGE_FRAME, frame_elapsed * 1e9);
+        // a fast replay runs the render loop flat out
+        if (frame_elapsed < FRAME_TIME && !(replay_thread && replay.fast)) {
             double sleep_duration = FRAME_TIME - frame_elapsed;
             sleep_time.tv_sec = (time_t)sleep_duration;
             sleep_time.tv_nsec = (long)((sleep_duration - sleep_time.tv_sec) * 1e9);
             nanosleep(&sleep_time, NULL);
         }
-
-        // draw fps
-        clock_gettime(CLOCK_MONOTONIC, &end); // Update `end` to include sleep time
-        frame_elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-        double fps = 1.0 / frame_elapsed;
-
-        snprintf(fps_text, sizeof(fps_text), "FPS: %.2f", fps);
     }
 
     ret = EXIT_SUCCESS;
 
 cleanup:
     running = false;
-    pthread_join(listener_thread, NULL);
-    pthread_mutex_destroy(&shared_data.mutex);
-    pthread_cond_destroy(&shared_data.cond);
+
+    for (size_t i = 0; i < listeners; i++) {
+        if (listener_threads[i]) {
+            pthread_join(listener_threads[i], NULL);
+        }
+    }
+    if (replay_thread) {
+        pthread_join(replay_thread, NULL);
+    }
+    ingest_parse_free(&parse);
+
+    if (watcher_thread) {
+        pthread_join(watcher_thread, NULL);
+    }
+
+    if (export_thread) {
+        pthread_join(export_thread, NULL);
+    }
+    exporter_close(exporter);
+    trace_close(trace_log);
+    if (ingests[0]) {
+        capture_close(ingests[0]->capture);
+    }
+    for (size_t i = 0; i < listeners; i++) {
+        ingest_close(ingests[i]);
+    }
+    capture_close(replay.capture);
+
+    if (reloader.pending) {
+        unload_config(reloader.pending);
+        free(reloader.pending);
+    }
+    pthread_mutex_destroy(&reloader.mutex);
+
+    history_store_close(history);
 
     unload_config(&config);
 
+    // after every config has released its fonts
+    font_manager_shutdown();
+
     if (fb) {
         fb_deinit(fb);
     }
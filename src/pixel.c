@@ -0,0 +1,195 @@
+#include "pixel.h"
+#include "fb.h"
+#include "simd.h"
+
+uint16_t rgb_to_rgb565(uint8_t r, uint8_t g, uint8_t b) {
+    uint16_t rs = (r * 31) / 255;
+    uint16_t gs = (g * 63) / 255;
+    uint16_t bs = (b * 31) / 255;
+
+    return (rs << 11) | (gs << 5) | bs;
+}
+
+static uint32_t rgb_to_rgb565_color(uint8_t r, uint8_t g, uint8_t b) {
+    return rgb_to_rgb565(r, g, b);
+}
+
+static uint32_t rgb_to_rgb888(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+// blend n premultiplied rgb565 pixels over dst: d = s + d * (255 - a) / 255
+static void blend_rgb565_row(uint8_t *dst8, const uint8_t *src8, const uint8_t *alpha, size_t n) {
+    uint16_t *dst = (uint16_t *)dst8;
+    const uint16_t *src = (const uint16_t *)src8;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi16(0xff);
+    const __m128i round = _mm_set1_epi16(0x80);
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(alpha + i)), zero);
+        __m128i inv = _mm_sub_epi16(ff, a);
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+        __m128i dr = _mm_mullo_epi16(_mm_srli_epi16(d, 11), inv);
+        __m128i dg = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(d, 5), mask6), inv);
+        __m128i db = _mm_mullo_epi16(_mm_and_si128(d, mask5), inv);
+
+        // exact x / 255 for 16 bit x: (x + 128 + ((x + 128) >> 8)) >> 8
+        dr = _mm_add_epi16(dr, round);
+        dr = _mm_srli_epi16(_mm_add_epi16(dr, _mm_srli_epi16(dr, 8)), 8);
+        dg = _mm_add_epi16(dg, round);
+        dg = _mm_srli_epi16(_mm_add_epi16(dg, _mm_srli_epi16(dg, 8)), 8);
+        db = _mm_add_epi16(db, round);
+        db = _mm_srli_epi16(_mm_add_epi16(db, _mm_srli_epi16(db, 8)), 8);
+
+        __m128i out = _mm_add_epi16(s, _mm_or_si128(_mm_or_si128(_mm_slli_epi16(dr, 11), _mm_slli_epi16(dg, 5)), db));
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+#endif
+
+    for (; i < n; i++) {
+        uint8_t a = alpha[i];
+        if (a == 0xff) {
+            dst[i] = src[i];
+        } else if (a) {
+            uint32_t inv = 0xff - a;
+            uint32_t d = dst[i];
+            uint32_t r = ((d >> 11) * inv + 127) / 255;
+            uint32_t g = (((d >> 5) & 0x3f) * inv + 127) / 255;
+            uint32_t b = ((d & 0x1f) * inv + 127) / 255;
+            dst[i] = src[i] + ((r << 11) | (g << 5) | b);
+        }
+    }
+}
+
+// same blend for layouts with one byte per channel
+static inline void blend_bytes_row(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, size_t i, size_t n, size_t Bpp) {
+    for (; i < n; i++) {
+        uint8_t a = alpha[i];
+        if (a == 0xff) {
+            memcpy(dst + i * Bpp, src + i * Bpp, Bpp);
+        } else if (a) {
+            uint32_t inv = 0xff - a;
+            for (size_t c = 0; c < Bpp; c++) {
+                uint8_t *d = dst + i * Bpp + c;
+                *d = src[i * Bpp + c] + (*d * inv + 127) / 255;
+            }
+        }
+    }
+}
+
+static void blend_xrgb8888_row(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, size_t n) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    const __m128i round = _mm_set1_epi16(0x80);
+
+    for (; i + 4 <= n; i += 4) {
+        uint32_t a4;
+        memcpy(&a4, alpha + i, sizeof(a4));
+
+        // spread each pixel's alpha over its four channel bytes
+        __m128i a = _mm_cvtsi32_si128(a4);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i inv = _mm_sub_epi8(ff, a);
+
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i * 4));
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(inv, zero));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(inv, zero));
+        lo = _mm_add_epi16(lo, round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_add_epi16(hi, round);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        __m128i out = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), out);
+    }
+#endif
+
+    blend_bytes_row(dst, src, alpha, i, n, 4);
+}
+
+static void blend_bgr888_row(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, size_t n) {
+    blend_bytes_row(dst, src, alpha, 0, n, 3);
+}
+
+// 16 and 32 bit spans go through the vectorized fills
+static void fill_rgb565(uint8_t *dst, size_t n, uint32_t color) {
+    simd->fill16(dst, n, color);
+}
+
+static void fill_xrgb8888(uint8_t *dst, size_t n, uint32_t color) {
+    simd->fill32(dst, n, color);
+}
+
+#define PIXEL_NAME rgb565
+#define PIXEL_BPP 2
+#define PIXEL_PUT(p, c) (*(uint16_t *)(p) = (uint16_t)(c))
+#define PIXEL_RGB rgb_to_rgb565_color
+#define PIXEL_BLEND blend_rgb565_row
+#define PIXEL_HSPAN fill_rgb565
+#include "pixel_kernels.h"
+
+#define PIXEL_NAME xrgb8888
+#define PIXEL_BPP 4
+#define PIXEL_PUT(p, c) (*(uint32_t *)(p) = (c))
+#define PIXEL_RGB rgb_to_rgb888
+#define PIXEL_BLEND blend_xrgb8888_row
+#define PIXEL_HSPAN fill_xrgb8888
+#include "pixel_kernels.h"
+
+#define PIXEL_NAME bgr888
+#define PIXEL_BPP 3
+#define PIXEL_PUT(p, c) ((p)[0] = (uint8_t)(c), (p)[1] = (uint8_t)((c) >> 8), (p)[2] = (uint8_t)((c) >> 16))
+#define PIXEL_RGB rgb_to_rgb888
+#define PIXEL_BLEND blend_bgr888_row
+#include "pixel_kernels.h"
+
+static const PixelFormat *pixel_formats[] = {
+    &pixel_format_rgb565,
+    &pixel_format_xrgb8888,
+    &pixel_format_bgr888,
+};
+
+static bool bitfield_is(const struct fb_bitfield *f, uint32_t offset, uint32_t length) {
+    return f->offset == offset && f->length == length && !f->msb_right;
+}
+
+const PixelFormat *pixel_format_from_var(const struct fb_var_screeninfo *vinfo) {
+    if (vinfo->bits_per_pixel == 16 && bitfield_is(&vinfo->red, 11, 5) && bitfield_is(&vinfo->green, 5, 6) && bitfield_is(&vinfo->blue, 0, 5)) {
+        return &pixel_format_rgb565;
+    }
+
+    if (bitfield_is(&vinfo->red, 16, 8) && bitfield_is(&vinfo->green, 8, 8) && bitfield_is(&vinfo->blue, 0, 8)) {
+        if (vinfo->bits_per_pixel == 32) {
+            return &pixel_format_xrgb8888;
+        }
+        if (vinfo->bits_per_pixel == 24) {
+            return &pixel_format_bgr888;
+        }
+    }
+
+    return NULL;
+}
+
+const PixelFormat *pixel_format_by_name(const char *name) {
+    for (size_t i = 0; i < sizeof(pixel_formats) / sizeof(pixel_formats[0]); i++) {
+        if (strcmp(pixel_formats[i]->name, name) == 0) {
+            return pixel_formats[i];
+        }
+    }
+
+    return NULL;
+}
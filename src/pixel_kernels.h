@@ -0,0 +1,145 @@
+// Kernel template, included once per pixel format by pixel.c with:
+//   PIXEL_NAME       identifier prefix for the generated functions
+//   PIXEL_BPP        bytes per pixel
+//   PIXEL_PUT(p, c)  store native color c at byte address p
+//   PIXEL_RGB        function converting 8 bit r, g, b to the native color
+//   PIXEL_BLEND      premultiplied alpha row blend for the layout
+//   PIXEL_HSPAN      optional span fill replacing the generated one
+
+#define KERNEL__(name, fn) name##_##fn
+#define KERNEL_(name, fn) KERNEL__(name, fn)
+#define KERNEL(fn) KERNEL_(PIXEL_NAME, fn)
+#define KERNEL_FORMAT__(name) pixel_format_##name
+#define KERNEL_FORMAT_(name) KERNEL_FORMAT__(name)
+#define KERNEL_STR__(name) #name
+#define KERNEL_STR_(name) KERNEL_STR__(name)
+
+static void KERNEL(put)(uint8_t *dst, uint32_t color) {
+    PIXEL_PUT(dst, color);
+}
+
+#ifndef PIXEL_HSPAN
+static void KERNEL(hspan)(uint8_t *dst, size_t n, uint32_t color) {
+    for (size_t i = 0; i < n; i++) {
+        PIXEL_PUT(dst, color);
+        dst += PIXEL_BPP;
+    }
+}
+#define PIXEL_HSPAN KERNEL(hspan)
+#endif
+
+static void KERNEL(vspan)(uint8_t *dst, size_t stride, size_t n, uint32_t color) {
+    for (size_t i = 0; i < n; i++) {
+        PIXEL_PUT(dst, color);
+        dst += stride;
+    }
+}
+
+static void KERNEL(draw_mask)(uint8_t *dst, size_t stride, const uint8_t *mask, size_t pitch, size_t w, size_t h, uint32_t color) {
+    for (size_t y = 0; y < h; y++) {
+        uint8_t *p = dst;
+        for (size_t x = 0; x < w; x++) {
+            if (mask[x]) {
+                PIXEL_PUT(p, color);
+            }
+            p += PIXEL_BPP;
+        }
+        dst += stride;
+        mask += pitch;
+    }
+}
+
+static void KERNEL(draw_line)(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, uint32_t color) {
+    int dx = abs((int)x2 - (int)x1);
+    int dy = abs((int)y2 - (int)y1);
+    int sx = x1 < x2 ? 1 : -1;
+    int sy = y1 < y2 ? 1 : -1;
+    int err = dx - dy;
+
+    while (1) {
+        if (x1 < fb->w && y1 < fb->h) {
+            PIXEL_PUT(fb->bb + y1 * fb->stride + x1 * PIXEL_BPP, color);
+        }
+
+        if (x1 == x2 && y1 == y2) {
+            break;
+        }
+
+        int e2 = 2 * err;
+
+        if (e2 > -dy) {
+            err -= dy;
+            x1 += sx;
+        }
+
+        if (e2 < dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+static void KERNEL(draw_line_shaded)(FrameBuffer *fb, size_t x1, size_t y1, size_t x2, size_t y2, size_t bottom, uint32_t line_color, uint32_t shade_color) {
+    int dx = abs((int)x2 - (int)x1);
+    int dy = abs((int)y2 - (int)y1);
+    int sx = x1 < x2 ? 1 : -1;
+    int sy = y1 < y2 ? 1 : -1;
+    int err = dx - dy;
+
+    if (bottom >= fb->h) {
+        bottom = fb->h - 1;
+    }
+
+    while (1) {
+        if (x1 < fb->w && y1 < fb->h) {
+            PIXEL_PUT(fb->bb + y1 * fb->stride + x1 * PIXEL_BPP, line_color);
+        }
+
+        if (x1 == x2 && y1 == y2) {
+            break;
+        }
+
+        int e2 = 2 * err;
+
+        if (e2 > -dy) {
+            err -= dy;
+            x1 += sx;
+            if (y1 < bottom && x1 < fb->w) {
+                KERNEL(vspan)(fb->bb + (y1 + 1) * fb->stride + x1 * PIXEL_BPP, fb->stride, bottom - y1, shade_color);
+            }
+        }
+
+        if (e2 < dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+const PixelFormat KERNEL_FORMAT_(PIXEL_NAME) = {
+    .name = KERNEL_STR_(PIXEL_NAME),
+    .bpp = PIXEL_BPP * 8,
+    .Bpp = PIXEL_BPP,
+    .rgb = PIXEL_RGB,
+    .put = KERNEL(put),
+    .hspan = PIXEL_HSPAN,
+    .vspan = KERNEL(vspan),
+    .draw_mask = KERNEL(draw_mask),
+    .draw_line = KERNEL(draw_line),
+    .draw_line_shaded = KERNEL(draw_line_shaded),
+    .blend_row = PIXEL_BLEND,
+};
+
+#undef KERNEL
+#undef KERNEL_
+#undef KERNEL__
+#undef KERNEL_FORMAT_
+#undef KERNEL_FORMAT__
+#undef KERNEL_STR_
+#undef KERNEL_STR__
+#undef PIXEL_NAME
+#undef PIXEL_BPP
+#undef PIXEL_PUT
+#undef PIXEL_RGB
+#undef PIXEL_BLEND
+#undef PIXEL_HSPAN
@@ -0,0 +1,183 @@
+#include "reload.h"
+
+static void add_watch(Reloader *r, const char *path) {
+    char *dir_copy = strdup(path);
+    char *base_copy = strdup(path);
+    if (!dir_copy || !base_copy) {
+        goto cleanup;
+    }
+
+    int wd = inotify_add_watch(r->fd, dirname(dir_copy), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        fprintf(stderr, "Unable to watch %s for changes\n", path);
+        goto cleanup;
+    }
+
+    Watch *new_ptr = realloc(r->watches, sizeof(Watch) * (r->watch_count + 1));
+    if (new_ptr == NULL) {
+        perror("Error: Memory allocation failed");
+        goto cleanup;
+    }
+    r->watches = new_ptr;
+
+    r->watches[r->watch_count].wd = wd;
+    r->watches[r->watch_count].name = strdup(basename(base_copy));
+    r->watch_count++;
+
+    cleanup:
+    if (dir_copy) {
+        free(dir_copy);
+    }
+    if (base_copy) {
+        free(base_copy);
+    }
+}
+
+static void clear_watches(Reloader *r) {
+    for (size_t i = 0; i < r->watch_count; i++) {
+        free(r->watches[i].name);
+    }
+    free(r->watches);
+    r->watches = NULL;
+    r->watch_count = 0;
+}
+
+// watch the config file and every asset the given config references
+static void update_watches(Reloader *r, const Config *config) {
+    clear_watches(r);
+
+    add_watch(r, r->filename);
+    for (size_t i = 0; i < config->font_count; i++) {
+        add_watch(r, config->fonts[i].filename);
+    }
+    for (size_t i = 0; i < config->png_count; i++) {
+        add_watch(r, config->pngs[i].filename);
+    }
+}
+
+static bool is_watched(Reloader *r, struct inotify_event *event) {
+    for (size_t i = 0; i < r->watch_count; i++) {
+        if (r->watches[i].wd == event->wd && event->len && r->watches[i].name && strcmp(r->watches[i].name, event->name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// read all queued events, returns true if any of them touched a watched file
+static bool drain_events(Reloader *r) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(r->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (is_watched(r, event)) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+static void reload(Reloader *r) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Config *config = calloc(1, sizeof(Config));
+    if (config == NULL) {
+        perror("Error: Memory allocation failed");
+        return;
+    }
+
+    if (load_config(r->filename, config, r->fmt, r->live) != 0) {
+        fprintf(stderr, "Reloading %s failed, keeping the current config\n", r->filename);
+        unload_config(config);
+        free(config);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->build_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    printf("Reloaded %s in %.1f ms, reused %ld/%ld fonts and %ld/%ld pngs\n", r->filename, r->build_ms,
+           config->fonts_reused, config->font_count, config->pngs_reused, config->png_count);
+
+    // a newer build replaces one the render loop has not picked up yet
+    if (r->pending) {
+        unload_config(r->pending);
+        free(r->pending);
+    }
+    r->pending = config;
+
+    update_watches(r, config);
+}
+
+void *config_watcher(void *arg) {
+    Reloader *r = (Reloader *)arg;
+
+    r->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (r->fd < 0) {
+        perror("inotify_init1 failed, config reload disabled");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&r->mutex);
+    update_watches(r, r->live);
+    pthread_mutex_unlock(&r->mutex);
+
+    struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+
+    while (running) {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+
+        if (!drain_events(r)) {
+            continue;
+        }
+
+        // editors write in several steps, wait for them to settle
+        do {
+            usleep(RELOAD_SETTLE_MS * 1000);
+        } while (drain_events(r));
+
+        pthread_mutex_lock(&r->mutex);
+        reload(r);
+        pthread_mutex_unlock(&r->mutex);
+    }
+
+    clear_watches(r);
+    close(r->fd);
+    return NULL;
+}
+
+// swap in a pending config, called by the render loop between frames; returns
+// true if the config changed and the background has to be redrawn
+bool reloader_apply(Reloader *r, Config *config) {
+    if (pthread_mutex_trylock(&r->mutex) != 0) {
+        return false;
+    }
+
+    if (!r->pending) {
+        pthread_mutex_unlock(&r->mutex);
+        return false;
+    }
+
+    Config old = *config;
+    *config = *r->pending;
+    free(r->pending);
+    r->pending = NULL;
+
+    size_t kept = config_adopt(config, &old);
+    unload_config(&old);
+
+    pthread_mutex_unlock(&r->mutex);
+
+    printf("Applied config, %ld widgets kept their history\n", kept);
+    return true;
+}
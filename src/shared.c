@@ -0,0 +1,68 @@
+#include "shared.h"
+
+static void shared_queue_sleep(void) {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = SHARED_QUEUE_WAIT_NS};
+    nanosleep(&ts, NULL);
+}
+
+// listener: the next free slot, its buffer big enough for any payload; NULL
+// if the queue is full. Nothing is queued until it is committed, a slot left
+// uncommitted is handed out again.
+SharedPacket *shared_queue_reserve(SharedQueue *q, bool wait) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    while (head - atomic_load_explicit(&q->tail, memory_order_acquire) == SHARED_QUEUE_PACKETS) {
+        if (!wait || !running) {
+            return NULL;
+        }
+        shared_queue_sleep();
+    }
+
+    // the render loop is done with this slot until head moves past it
+    SharedPacket *p = &q->packets[head % SHARED_QUEUE_PACKETS];
+    if (p->buffer == NULL) {
+        p->buffer = malloc(SHARED_BUFFER_SIZE);
+        if (p->buffer == NULL) {
+            return NULL;
+        }
+        p->capacity = SHARED_BUFFER_SIZE;
+    }
+
+    return p;
+}
+
+// listener: queue the reserved slot for the render loop
+void shared_queue_commit(SharedQueue *q) {
+    atomic_store_explicit(&q->head, atomic_load_explicit(&q->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// render loop: the oldest packet, NULL if there is none; it stays the render
+// loop's until released
+SharedPacket *shared_queue_peek(SharedQueue *q) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return NULL;
+    }
+    return &q->packets[tail % SHARED_QUEUE_PACKETS];
+}
+
+// render loop: give the oldest packet's slot back to the listener
+void shared_queue_release(SharedQueue *q) {
+    atomic_store_explicit(&q->tail, atomic_load_explicit(&q->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// listener: wait until the render loop has taken every packet
+void shared_queue_drain(SharedQueue *q) {
+    while (running && atomic_load_explicit(&q->tail, memory_order_acquire) != atomic_load_explicit(&q->head, memory_order_relaxed)) {
+        shared_queue_sleep();
+    }
+}
+
+void shared_queue_free(SharedQueue *q) {
+    for (size_t i = 0; i < SHARED_QUEUE_PACKETS; i++) {
+        free(q->packets[i].buffer);
+        q->packets[i].buffer = NULL;
+        q->packets[i].capacity = 0;
+    }
+}
@@ -0,0 +1,295 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+static void scalar_fill16(uint8_t *dst, size_t n, uint16_t color) {
+    uint16_t *p = (uint16_t *)dst;
+    for (size_t i = 0; i < n; i++) {
+        p[i] = color;
+    }
+}
+
+static void scalar_fill32(uint8_t *dst, size_t n, uint32_t color) {
+    uint32_t *p = (uint32_t *)dst;
+    for (size_t i = 0; i < n; i++) {
+        p[i] = color;
+    }
+}
+
+static void scalar_copy(uint8_t *dst, const uint8_t *src, size_t n) {
+    memcpy(dst, src, n);
+}
+
+static const SimdOps simd_scalar = {
+    .name = "scalar",
+    .fill16 = scalar_fill16,
+    .fill32 = scalar_fill32,
+    .copy = scalar_copy,
+    .stream = scalar_copy,
+};
+
+#ifdef SIMD_X86
+// fill bytes up to an aligned address with the scalar pattern, returns the
+// number of pixels written
+static inline size_t fill16_head(uint8_t *dst, size_t n, uint16_t color, size_t align) {
+    size_t head = 0;
+    while (head < n && ((uintptr_t)(dst + head * 2) & (align - 1))) {
+        ((uint16_t *)dst)[head++] = color;
+    }
+    return head;
+}
+
+static inline size_t fill32_head(uint8_t *dst, size_t n, uint32_t color, size_t align) {
+    size_t head = 0;
+    while (head < n && ((uintptr_t)(dst + head * 4) & (align - 1))) {
+        ((uint32_t *)dst)[head++] = color;
+    }
+    return head;
+}
+
+static inline void fill_sse2(uint8_t *dst, size_t bytes, __m128i v) {
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        _mm_store_si128((__m128i *)(dst + i), v);
+        _mm_store_si128((__m128i *)(dst + i + 16), v);
+        _mm_store_si128((__m128i *)(dst + i + 32), v);
+        _mm_store_si128((__m128i *)(dst + i + 48), v);
+    }
+    for (; i + 16 <= bytes; i += 16) {
+        _mm_store_si128((__m128i *)(dst + i), v);
+    }
+}
+
+static void sse2_fill16(uint8_t *dst, size_t n, uint16_t color) {
+    size_t head = fill16_head(dst, n, color, 16);
+    size_t body = (n - head) & ~(size_t)7;
+    fill_sse2(dst + head * 2, body * 2, _mm_set1_epi16(color));
+    scalar_fill16(dst + (head + body) * 2, n - head - body, color);
+}
+
+static void sse2_fill32(uint8_t *dst, size_t n, uint32_t color) {
+    size_t head = fill32_head(dst, n, color, 16);
+    size_t body = (n - head) & ~(size_t)3;
+    fill_sse2(dst + head * 4, body * 4, _mm_set1_epi32(color));
+    scalar_fill32(dst + (head + body) * 4, n - head - body, color);
+}
+
+static void sse2_copy(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), d);
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+// write-combining buffers flush best on whole 64 byte lines, so streaming
+// starts at the first 64 byte boundary and never reads the destination
+static void sse2_stream(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t head = (64 - ((uintptr_t)dst & 63)) & 63;
+    if (head > n) {
+        head = n;
+    }
+    memcpy(dst, src, head);
+
+    size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_stream_si128((__m128i *)(dst + i), a);
+        _mm_stream_si128((__m128i *)(dst + i + 16), b);
+        _mm_stream_si128((__m128i *)(dst + i + 32), c);
+        _mm_stream_si128((__m128i *)(dst + i + 48), d);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm_stream_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+    _mm_sfence();
+    memcpy(dst + i, src + i, n - i);
+}
+
+static const SimdOps simd_sse2 = {
+    .name = "sse2",
+    .fill16 = sse2_fill16,
+    .fill32 = sse2_fill32,
+    .copy = sse2_copy,
+    .stream = sse2_stream,
+};
+
+__attribute__((target("avx2")))
+static inline void fill_avx2(uint8_t *dst, size_t bytes, __m256i v) {
+    size_t i = 0;
+    for (; i + 128 <= bytes; i += 128) {
+        _mm256_store_si256((__m256i *)(dst + i), v);
+        _mm256_store_si256((__m256i *)(dst + i + 32), v);
+        _mm256_store_si256((__m256i *)(dst + i + 64), v);
+        _mm256_store_si256((__m256i *)(dst + i + 96), v);
+    }
+    for (; i + 32 <= bytes; i += 32) {
+        _mm256_store_si256((__m256i *)(dst + i), v);
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_fill16(uint8_t *dst, size_t n, uint16_t color) {
+    size_t head = fill16_head(dst, n, color, 32);
+    size_t body = (n - head) & ~(size_t)15;
+    fill_avx2(dst + head * 2, body * 2, _mm256_set1_epi16(color));
+    scalar_fill16(dst + (head + body) * 2, n - head - body, color);
+}
+
+__attribute__((target("avx2")))
+static void avx2_fill32(uint8_t *dst, size_t n, uint32_t color) {
+    size_t head = fill32_head(dst, n, color, 32);
+    size_t body = (n - head) & ~(size_t)7;
+    fill_avx2(dst + head * 4, body * 4, _mm256_set1_epi32(color));
+    scalar_fill32(dst + (head + body) * 4, n - head - body, color);
+}
+
+__attribute__((target("avx2")))
+static void avx2_copy(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), c);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), d);
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_stream(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t head = (64 - ((uintptr_t)dst & 63)) & 63;
+    if (head > n) {
+        head = n;
+    }
+    memcpy(dst, src, head);
+
+    size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        _mm256_stream_si256((__m256i *)(dst + i), a);
+        _mm256_stream_si256((__m256i *)(dst + i + 32), b);
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm256_stream_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+    }
+    _mm_sfence();
+    memcpy(dst + i, src + i, n - i);
+}
+
+static const SimdOps simd_avx2 = {
+    .name = "avx2",
+    .fill16 = avx2_fill16,
+    .fill32 = avx2_fill32,
+    .copy = avx2_copy,
+    .stream = avx2_stream,
+};
+#endif
+
+#ifdef SIMD_NEON
+static void neon_fill16(uint8_t *dst, size_t n, uint16_t color) {
+    uint16x8_t v = vdupq_n_u16(color);
+    uint16_t *p = (uint16_t *)dst;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        vst1q_u16(p + i, v);
+        vst1q_u16(p + i + 8, v);
+        vst1q_u16(p + i + 16, v);
+        vst1q_u16(p + i + 24, v);
+    }
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u16(p + i, v);
+    }
+    scalar_fill16(dst + i * 2, n - i, color);
+}
+
+static void neon_fill32(uint8_t *dst, size_t n, uint32_t color) {
+    uint32x4_t v = vdupq_n_u32(color);
+    uint32_t *p = (uint32_t *)dst;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u32(p + i, v);
+        vst1q_u32(p + i + 4, v);
+        vst1q_u32(p + i + 8, v);
+        vst1q_u32(p + i + 12, v);
+    }
+    for (; i + 4 <= n; i += 4) {
+        vst1q_u32(p + i, v);
+    }
+    scalar_fill32(dst + i * 4, n - i, color);
+}
+
+static void neon_copy(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint8x16x4_t v = vld1q_u8_x4(src + i);
+        vst1q_u8_x4(dst + i, v);
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+// neon has no non-temporal store intrinsic, full 64 byte writes are the
+// best that can be done for write-combined memory
+static const SimdOps simd_neon = {
+    .name = "neon",
+    .fill16 = neon_fill16,
+    .fill32 = neon_fill32,
+    .copy = neon_copy,
+    .stream = neon_copy,
+};
+#endif
+
+const SimdOps *simd = &simd_scalar;
+
+size_t simd_variants(const SimdOps **variants, size_t max) {
+    size_t count = 0;
+
+    if (count < max) {
+        variants[count++] = &simd_scalar;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (count < max && __builtin_cpu_supports("sse2")) {
+        variants[count++] = &simd_sse2;
+    }
+    if (count < max && __builtin_cpu_supports("avx2")) {
+        variants[count++] = &simd_avx2;
+    }
+#endif
+#ifdef SIMD_NEON
+    if (count < max) {
+        variants[count++] = &simd_neon;
+    }
+#endif
+
+    return count;
+}
+
+// pick the widest variant the cpu supports
+void simd_init() {
+    const SimdOps *variants[4];
+    size_t count = simd_variants(variants, 4);
+
+    simd = variants[count - 1];
+}
@@ -0,0 +1,448 @@
+#include "snapshot.h"
+
+typedef struct _StringTable {
+    char *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} StringTable;
+
+// offset of s in the table, adding it if needed; 0 is reserved for NULL
+static uint32_t string_add(StringTable *t, const char *s) {
+    if (!s) {
+        return 0;
+    }
+
+    for (size_t off = 1; off < t->size; off += strlen(t->data + off) + 1) {
+        if (strcmp(t->data + off, s) == 0) {
+            return off;
+        }
+    }
+
+    size_t len = strlen(s) + 1;
+    if (t->size + len > t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 4096;
+        while (capacity < t->size + len) {
+            capacity *= 2;
+        }
+
+        char *data = realloc(t->data, capacity);
+        if (data == NULL) {
+            t->failed = true;
+            return 0;
+        }
+        t->data = data;
+        t->capacity = capacity;
+    }
+
+    uint32_t off = t->size;
+    memcpy(t->data + off, s, len);
+    t->size += len;
+    return off;
+}
+
+static uint32_t snapshot_ref(const void *ptr, const void *base, size_t size) {
+    return ptr ? (uint32_t)(((const uint8_t *)ptr - (const uint8_t *)base) / size) : SNAPSHOT_NONE;
+}
+
+// report everything load_config() silently ignores; returns the error count
+static int validate_config(const char *filename, const Config *config) {
+    int errors = 0;
+
+    for (size_t i = 0; i < config->widget_count; i++) {
+        const Widget *w = &config->widgets[i];
+
+        if (w->kind == WIDGET_UNKNOWN) {
+            fprintf(stderr, "%s: widget %zu: unknown type '%s'\n", filename, i, w->type ? w->type : "");
+            errors++;
+            continue;
+        }
+
+        if ((w->kind == WIDGET_TEXT || w->kind == WIDGET_VALUE || w->kind == WIDGET_STATS) && !w->font) {
+            fprintf(stderr, "%s: widget %zu: font '%s' is not listed in fonts\n", filename, i, w->filename ? w->filename : "");
+            errors++;
+        }
+
+        if (w->kind == WIDGET_PNG && !w->png) {
+            fprintf(stderr, "%s: widget %zu: png '%s' is not listed in pngs\n", filename, i, w->filename ? w->filename : "");
+            errors++;
+        }
+
+        if ((w->kind == WIDGET_GRAPH || w->kind == WIDGET_VALUE) && !w->identifier) {
+            fprintf(stderr, "%s: widget %zu: warning: %s has no identifier\n", filename, i, w->type);
+        }
+    }
+
+    return errors;
+}
+
+// validate config.json by loading it, then write it out flat; colors are
+// loaded as xrgb8888, which is plain 0xRRGGBB
+int compile_config(const char *filename, const char *output) {
+    int ret = -1;
+    Config config = {0};
+    StringTable strings = {0};
+    SnapshotWidget *widgets = NULL;
+    SnapshotFont *fonts = NULL;
+    SnapshotPng *pngs = NULL;
+    SnapshotHeader header = {0};
+    FILE *fp = NULL;
+    char tmp[1024];
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", output, getpid());
+
+    if (!asset_stamp(filename, &header.source)) {
+        fprintf(stderr, "Error: Failed to open config file %s\n", filename);
+        goto cleanup;
+    }
+
+    if (load_config(filename, &config, &pixel_format_xrgb8888, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to load config file %s\n", filename);
+        goto cleanup;
+    }
+
+    int errors = validate_config(filename, &config);
+    if (errors) {
+        fprintf(stderr, "%s: %d error(s), no snapshot written\n", filename, errors);
+        goto cleanup;
+    }
+
+    widgets = calloc(config.widget_count + 1, sizeof(SnapshotWidget));
+    fonts = calloc(config.font_count + 1, sizeof(SnapshotFont));
+    pngs = calloc(config.png_count + 1, sizeof(SnapshotPng));
+    if (!widgets || !fonts || !pngs) {
+        perror("Error: Memory allocation failed");
+        goto cleanup;
+    }
+
+    // offset 0 is the empty string, standing in for NULL
+    string_add(&strings, "");
+
+    for (size_t i = 0; i < config.widget_count; i++) {
+        Widget *w = &config.widgets[i];
+        widgets[i] = (SnapshotWidget){
+            .type = string_add(&strings, w->type),
+            .identifier = string_add(&strings, w->identifier),
+            .source = string_add(&strings, w->source),
+            .filename = string_add(&strings, w->filename),
+            .text = string_add(&strings, w->text),
+            .top = w->top,
+            .left = w->left,
+            .width = w->width,
+            .height = w->height,
+            .min = w->min,
+            .max = w->max,
+            .scale = w->scale,
+            .precision = w->precision,
+            .window = w->window,
+            .gap = w->gap,
+            .stale = w->stale,
+            .has_border = w->has_border,
+            .border_color = w->border_color,
+            .line_color = w->line_color,
+            .font = snapshot_ref(w->font, config.fonts, sizeof(Font)),
+            .png = snapshot_ref(w->png, config.pngs, sizeof(Png)),
+            .next_same = snapshot_ref(w->next_same, config.widgets, sizeof(Widget)),
+        };
+    }
+
+    for (size_t i = 0; i < config.font_count; i++) {
+        fonts[i].filename = string_add(&strings, config.fonts[i].filename);
+        fonts[i].size = config.fonts[i].size;
+    }
+
+    for (size_t i = 0; i < config.png_count; i++) {
+        pngs[i].filename = string_add(&strings, config.pngs[i].filename);
+    }
+
+    header.history_file = string_add(&strings, config.history_file);
+    header.history_slots = config.history_slots;
+    header.history_samples = config.history_samples;
+    header.export_socket = string_add(&strings, config.export_socket);
+    header.export_port = config.export_port;
+
+    if (strings.failed) {
+        perror("Error: Memory allocation failed");
+        goto cleanup;
+    }
+
+    // every section is 4 byte aligned, they are written back to back
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(SnapshotHeader);
+    header.widget_size = sizeof(SnapshotWidget);
+    header.widget_count = config.widget_count;
+    header.font_count = config.font_count;
+    header.png_count = config.png_count;
+    header.index_size = config.index_mask + 1;
+    header.widgets_offset = sizeof(SnapshotHeader);
+    header.fonts_offset = header.widgets_offset + header.widget_count * sizeof(SnapshotWidget);
+    header.pngs_offset = header.fonts_offset + header.font_count * sizeof(SnapshotFont);
+    header.index_offset = header.pngs_offset + header.png_count * sizeof(SnapshotPng);
+    header.strings_offset = header.index_offset + header.index_size * sizeof(uint32_t);
+    header.strings_size = strings.size;
+
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Failed to open %s for writing\n", tmp);
+        goto cleanup;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(widgets, sizeof(SnapshotWidget), header.widget_count, fp) != header.widget_count ||
+        fwrite(fonts, sizeof(SnapshotFont), header.font_count, fp) != header.font_count ||
+        fwrite(pngs, sizeof(SnapshotPng), header.png_count, fp) != header.png_count ||
+        fwrite(config.index, sizeof(uint32_t), header.index_size, fp) != header.index_size ||
+        fwrite(strings.data, 1, strings.size, fp) != strings.size) {
+        fprintf(stderr, "Error: Failed to write %s\n", tmp);
+        goto cleanup;
+    }
+
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        fprintf(stderr, "Error: Failed to write %s\n", tmp);
+        goto cleanup;
+    }
+    fp = NULL;
+
+    if (rename(tmp, output) != 0) {
+        perror("Error: Failed to rename config snapshot");
+        goto cleanup;
+    }
+
+    printf("Compiled %s to %s: %u widgets, %u fonts, %u pngs, %u bytes\n", filename, output,
+           header.widget_count, header.font_count, header.png_count, header.strings_offset + header.strings_size);
+    ret = 0;
+
+    cleanup:
+    if (fp) {
+        fclose(fp);
+    }
+
+    if (ret != 0) {
+        unlink(tmp);
+    }
+
+    free(widgets);
+    free(fonts);
+    free(pngs);
+    free(strings.data);
+    unload_config(&config);
+    return ret;
+}
+
+static bool section_valid(uint32_t offset, uint32_t count, size_t size, size_t len) {
+    return offset % sizeof(uint32_t) == 0 && (uint64_t)offset + (uint64_t)count * size <= len;
+}
+
+static bool string_valid(const SnapshotHeader *header, uint32_t off) {
+    return off < header->strings_size;
+}
+
+// bounds check everything the loader and config_find_widget() follow
+static bool snapshot_valid(const uint8_t *map, size_t len) {
+    const SnapshotHeader *header = (const SnapshotHeader *)map;
+
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+        header->header_size != sizeof(SnapshotHeader) || header->widget_size != sizeof(SnapshotWidget)) {
+        return false;
+    }
+
+    if (!section_valid(header->widgets_offset, header->widget_count, sizeof(SnapshotWidget), len) ||
+        !section_valid(header->fonts_offset, header->font_count, sizeof(SnapshotFont), len) ||
+        !section_valid(header->pngs_offset, header->png_count, sizeof(SnapshotPng), len) ||
+        !section_valid(header->index_offset, header->index_size, sizeof(uint32_t), len) ||
+        !section_valid(header->strings_offset, header->strings_size, 1, len)) {
+        return false;
+    }
+
+    const char *strings = (const char *)map + header->strings_offset;
+    if (!header->strings_size || strings[0] != '\0' || strings[header->strings_size - 1] != '\0' ||
+        !string_valid(header, header->history_file) || !string_valid(header, header->export_socket) ||
+        header->export_port > 65535 ||
+        (header->history_file && (header->history_slots < 2 || !header->history_samples))) {
+        return false;
+    }
+
+    const SnapshotWidget *widgets = (const SnapshotWidget *)(map + header->widgets_offset);
+    for (uint32_t i = 0; i < header->widget_count; i++) {
+        const SnapshotWidget *w = &widgets[i];
+        if (!w->type || !string_valid(header, w->type) || !string_valid(header, w->identifier) ||
+            !string_valid(header, w->source) ||
+            !string_valid(header, w->filename) || !string_valid(header, w->text)) {
+            return false;
+        }
+
+        // history sizes divide by the scale
+        if (!w->scale) {
+            return false;
+        }
+
+        // chains only point forward, so following them always terminates
+        if ((w->font != SNAPSHOT_NONE && w->font >= header->font_count) ||
+            (w->png != SNAPSHOT_NONE && w->png >= header->png_count) ||
+            (w->next_same != SNAPSHOT_NONE && (w->next_same <= i || w->next_same >= header->widget_count))) {
+            return false;
+        }
+    }
+
+    const SnapshotFont *fonts = (const SnapshotFont *)(map + header->fonts_offset);
+    for (uint32_t i = 0; i < header->font_count; i++) {
+        if (!fonts[i].filename || !string_valid(header, fonts[i].filename)) {
+            return false;
+        }
+    }
+
+    const SnapshotPng *pngs = (const SnapshotPng *)(map + header->pngs_offset);
+    for (uint32_t i = 0; i < header->png_count; i++) {
+        if (!pngs[i].filename || !string_valid(header, pngs[i].filename)) {
+            return false;
+        }
+    }
+
+    // power of two with at least one free slot, so probing terminates
+    const uint32_t *index = (const uint32_t *)(map + header->index_offset);
+    bool has_free = false;
+    if (!header->index_size || (header->index_size & (header->index_size - 1))) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->index_size; i++) {
+        if (!index[i]) {
+            has_free = true;
+        } else if (index[i] > header->widget_count || !widgets[index[i] - 1].identifier) {
+            return false;
+        }
+    }
+
+    return has_free;
+}
+
+static const char *snapshot_string(const char *strings, uint32_t off) {
+    return off ? strings + off : NULL;
+}
+
+static uint32_t snapshot_color(const PixelFormat *fmt, uint32_t rgb) {
+    return fmt->rgb((rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff);
+}
+
+// map a compiled snapshot and build the config from it; widget strings and
+// the identifier index are used in place. Fails if the snapshot is missing,
+// invalid or older than source, leaving config empty.
+int load_config_snapshot(const char *filename, const char *source, Config *config, const PixelFormat *fmt) {
+    struct stat st;
+    uint8_t *map = MAP_FAILED;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Ignoring invalid config snapshot %s\n", filename);
+        return -1;
+    }
+
+    const SnapshotHeader *header = (const SnapshotHeader *)map;
+    if (!snapshot_valid(map, st.st_size)) {
+        fprintf(stderr, "Ignoring invalid config snapshot %s, recompile it with --compile-config\n", filename);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    if (source && !asset_unchanged(source, &header->source)) {
+        fprintf(stderr, "Ignoring config snapshot %s, %s changed since it was compiled\n", filename, source);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    const char *strings = (const char *)map + header->strings_offset;
+    const SnapshotWidget *widgets = (const SnapshotWidget *)(map + header->widgets_offset);
+    const SnapshotFont *fonts = (const SnapshotFont *)(map + header->fonts_offset);
+    const SnapshotPng *pngs = (const SnapshotPng *)(map + header->pngs_offset);
+
+    config->fmt = fmt;
+    config->map = map;
+    config->map_len = st.st_size;
+
+    config->arena.block_size = (sizeof(Widget) + sizeof(double) + 2) * header->widget_count +
+                               sizeof(Font) * header->font_count + sizeof(Png) * header->png_count + ARENA_BLOCK_SIZE;
+    if (header->history_file) {
+        config->history_file = arena_strdup(&config->arena, strings + header->history_file);
+        config->history_slots = header->history_slots;
+        config->history_samples = header->history_samples;
+    }
+    if (header->export_socket) {
+        config->export_socket = arena_strdup(&config->arena, strings + header->export_socket);
+    }
+    config->export_port = header->export_port;
+
+    if (config_reserve(config, header->widget_count, header->font_count, header->png_count) != 0) {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < header->font_count; i++) {
+        if (config_add_font(config, strings + fonts[i].filename, fonts[i].size) != 0) {
+            goto cleanup;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->png_count; i++) {
+        if (config_add_png(config, strings + pngs[i].filename) != 0) {
+            goto cleanup;
+        }
+    }
+
+    if (config_load_assets(config, NULL) != 0) {
+        goto cleanup;
+    }
+
+    config->widget_count = header->widget_count;
+
+    for (uint32_t i = 0; i < header->widget_count; i++) {
+        const SnapshotWidget *s = &widgets[i];
+        Widget *w = &config->widgets[i];
+
+        w->type = (char *)snapshot_string(strings, s->type);
+        w->kind = widget_type(w->type);
+        w->identifier = (char *)snapshot_string(strings, s->identifier);
+        w->source = (char *)snapshot_string(strings, s->source);
+        w->filename = (char *)snapshot_string(strings, s->filename);
+        w->text = (char *)snapshot_string(strings, s->text);
+        w->top = s->top;
+        w->left = s->left;
+        w->width = s->width;
+        w->height = s->height;
+        w->min = s->min;
+        w->max = s->max;
+        w->scale = s->scale;
+        w->precision = s->precision;
+        w->window = s->window;
+        w->gap = s->gap;
+        w->stale = s->stale;
+        w->has_border = s->has_border;
+        w->border_color = snapshot_color(fmt, s->border_color);
+        w->line_color = snapshot_color(fmt, s->line_color);
+        w->font = s->font != SNAPSHOT_NONE ? &config->fonts[s->font] : NULL;
+        w->png = s->png != SNAPSHOT_NONE ? &config->pngs[s->png] : NULL;
+        w->next_same = s->next_same != SNAPSHOT_NONE ? &config->widgets[s->next_same] : NULL;
+    }
+
+    config->index = (uint32_t *)(map + header->index_offset);
+    config->index_mask = header->index_size - 1;
+
+    if (config_build_hot(config) != 0 || config_init_history(config) != 0) {
+        goto cleanup;
+    }
+    return 0;
+
+    cleanup:
+    unload_config(config);
+    memset(config, 0, sizeof(Config));
+    return -1;
+}
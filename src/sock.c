@@ -1,4 +1,6 @@
 #include "sock.h"
+#include "ingest.h"
+#include "uring.h"
 
 uint32_t _crc32(const uint8_t *data, size_t length) {
     uint32_t crc = ~0U;
@@ -36,22 +38,124 @@ void inflate_buffer(const uint8_t *input, size_t input_length, uint8_t *output,
     inflateEnd(&stream);
 }
 
+// inflate with a stream kept from packet to packet, reset rather than set up
+// again; output_length is 0 if the payload is bad
+bool inflate_packet(z_stream *stream, const uint8_t *input, size_t input_length, uint8_t *output, size_t *output_length) {
+    size_t capacity = *output_length;
+
+    *output_length = 0;
+    if (inflateReset(stream) != Z_OK) {
+        fprintf(stderr, "inflateReset failed\n");
+        return false;
+    }
+
+    stream->next_in = (Bytef *)input;
+    stream->avail_in = input_length;
+    stream->next_out = output;
+    stream->avail_out = capacity;
+
+    if (inflate(stream, Z_FINISH) != Z_STREAM_END) {
+        fprintf(stderr, "Inflate failed\n");
+        return false;
+    }
+
+    *output_length = stream->total_out;
+    return true;
+}
+
+// find the fields of a received packet, its whole size or 0 to drop it
+size_t packet_parse(const uint8_t *packet, size_t length, PacketHeader *h) {
+    uint32_t magic, payload_length;
+
+    memset(h, 0, sizeof(PacketHeader));
+
+    if (length < HEADER_SIZE) {
+        fprintf(stderr, "Short packet (%zu bytes), dropping\n", length);
+        stats_add(STAT_DROPPED, 1);
+        return 0;
+    }
+
+    memcpy(&magic, packet, sizeof(magic));
+    if (magic != MAGIC && magic != MAGIC_V2) {
+        fprintf(stderr, "Invalid magic (%x), dropping\n", magic);
+        stats_add(STAT_DROPPED, 1);
+        return 0;
+    }
+
+    memcpy(&payload_length, packet + CRC32_SIZE, sizeof(payload_length));
+    if (payload_length > MAX_PAYLOAD_LEN) {
+        fprintf(stderr, "Invalid payload length (%x), dropping\n", payload_length);
+        stats_add(STAT_DROPPED, 1);
+        return 0;
+    }
+
+    h->payload = HEADER_SIZE;
+    if (magic == MAGIC_V2) {
+        if (length < HEADER_SIZE + FLAGS_SIZE) {
+            fprintf(stderr, "Short packet (%zu bytes), dropping\n", length);
+            stats_add(STAT_DROPPED, 1);
+            return 0;
+        }
+
+        memcpy(&h->flags, packet + HEADER_SIZE, sizeof(h->flags));
+        if (h->flags & ~PACKET_FLAGS) {
+            fprintf(stderr, "Unknown packet flags (%x), dropping\n", h->flags);
+            stats_add(STAT_DROPPED, 1);
+            return 0;
+        }
+        h->payload += FLAGS_SIZE;
+
+        // the fields, as far as they were received
+        if (h->flags & PACKET_HOST_ID) {
+            if (length >= h->payload + HOST_ID_SIZE) {
+                memcpy(&h->host_id, packet + h->payload, sizeof(h->host_id));
+            }
+            h->payload += HOST_ID_SIZE;
+        }
+        if (h->flags & PACKET_SEQ) {
+            if (length >= h->payload + SEQ_SIZE) {
+                memcpy(&h->seq, packet + h->payload, sizeof(h->seq));
+            }
+            h->payload += SEQ_SIZE;
+        }
+        if (h->flags & PACKET_TIMESTAMP) {
+            if (length >= h->payload + TIMESTAMP_SIZE) {
+                memcpy(&h->timestamp, packet + h->payload, sizeof(h->timestamp));
+            }
+            h->payload += TIMESTAMP_SIZE;
+        }
+    }
+
+    h->payload_length = payload_length;
+    h->size = h->payload + payload_length + CRC32_SIZE;
+
+    if (length < h->size) {
+        fprintf(stderr, "Incomplete payload received, dropping\n");
+        stats_add(STAT_DROPPED, 1);
+        return 0;
+    }
+
+    return h->size;
+}
+
 void *udp_listener(void *arg) {
     int sockfd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+    struct sockaddr_in server_addr;
     uint8_t buffer[BUFFER_SIZE];
-    uint8_t decompressed_buffer[BUFFER_SIZE];
 
-    SharedBuffer* shared_data = (SharedBuffer*) arg;
+    Ingest *ingest = (Ingest *) arg;
+
+    stats_register(ingest->name);
 
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         perror("Socket creation failed");
         return NULL;
     }
 
-    if (fcntl(sockfd, F_SETFL, O_NONBLOCK) < 0) {
-        perror("Failed to set non-blocking mode");
+    // every listener binds the port, the kernel picks one for each sender
+    int reuse = 1;
+    if (ingest->listeners > 1 && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
         close(sockfd);
         return NULL;
     }
@@ -67,103 +171,40 @@ void *udp_listener(void *arg) {
         return NULL;
     }
 
-    printf("UDP listener thread started on port %d\n", PORT);
+    printf("UDP %s thread started on port %d\n", ingest->name, PORT);
 
+    // block for the next datagram, waking up now and then to notice a shutdown
     struct timeval timeout;
     timeout.tv_sec = 1;
     timeout.tv_usec = 0;
 
     if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
         perror("setsockopt failed");
+        close(sockfd);
         return NULL;
     }
 
-    while (running) {
-        ssize_t received;
-        size_t total_received = 0;
-        uint32_t payload_length = 0;
-
-        while (total_received < HEADER_SIZE) {
-            received = recvfrom(sockfd, buffer + total_received, BUFFER_SIZE - total_received, 0, (struct sockaddr *)&client_addr, &client_len);
-
-            if (received < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    usleep(100000);
-                    break;
-                } else {
-                    perror("recvfrom failed");
-                    break;
-                }
-            }
-
-            total_received += received;
-        }
-
-        if (total_received < HEADER_SIZE) {
-            continue;
-        }
-
-        uint32_t magic = *(uint32_t *)buffer;
-        if (magic != MAGIC) {
-            fprintf(stderr, "Invalid magic (%x), dropping\n", magic);
-            continue;
-        }
-
-        payload_length = *(uint32_t *)(buffer + CRC32_SIZE);
-        if (payload_length > MAX_PAYLOAD_LEN) {
-            fprintf(stderr, "Invalid payload length (%x), dropping\n", payload_length);
-            continue;
-        }
+    // straight from registered buffers when the kernel can, else a copy
+    // into ours per datagram
+    if (ingest->receive == INGEST_RECEIVE_URING && uring_receive(sockfd, ingest) == 0) {
+        close(sockfd);
+        return NULL;
+    }
 
-        size_t expected_size = payload_length + HEADER_SIZE + CRC32_SIZE;
-        while (total_received < expected_size) {
-            received = recvfrom(sockfd, buffer + HEADER_SIZE + total_received, expected_size - total_received, 0,
-                                (struct sockaddr *)&client_addr, &client_len);
-
-            if (received < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    usleep(1000);
-                    continue;
-                } else {
-                    perror("recvfrom failed");
-                    break;
-                }
+    while (running) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        // one datagram is one packet
+        ssize_t received = recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&client_addr, &client_len);
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("recvfrom failed");
             }
-            total_received += received;
-        }
-
-        if (total_received < expected_size) {
-            fprintf(stderr, "Incomplete payload received, dropping\n");
             continue;
         }
 
-        uint32_t received_crc = *(uint32_t *)(buffer + HEADER_SIZE + payload_length);
-        uint32_t computed_crc = _crc32(buffer + HEADER_SIZE, payload_length);
-
-        if (received_crc != computed_crc) {
-            fprintf(stderr, "CRC mismatch (%x != %x), dropping\n", received_crc, computed_crc);
-            continue;
-        }
-
-        uint8_t *payload = buffer + HEADER_SIZE;
-
-        // decompress packet
-        size_t decompressed_length = sizeof(decompressed_buffer) - 1;
-        inflate_buffer(payload, payload_length, decompressed_buffer, &decompressed_length);
-        if (!decompressed_length) {
-            continue;
-        }
-        //printf("%ld\n", decompressed_length);
-        decompressed_buffer[decompressed_length] = '\x00';
-        //printf(">>>%s<<<\n", decompressed_buffer);
-
-        // send packet data to main thread
-        pthread_mutex_lock(&shared_data->mutex);
-        memcpy(shared_data->buffer, decompressed_buffer, decompressed_length + 1);
-        shared_data->size = decompressed_length;
-        shared_data->data_available = true;
-        pthread_cond_signal(&shared_data->cond);
-        pthread_mutex_unlock(&shared_data->mutex);
+        ingest_packet(ingest, buffer, received, &client_addr);
     }
 
     close(sockfd);
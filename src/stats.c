@@ -0,0 +1,154 @@
+#include "stats.h"
+
+__thread StatsBlock *stats_local = NULL;
+StatsBlock stats_shared = { .name = "shared" };
+
+const char *const stats_stage_names[STATS_STAGES] = {
+    "crc", "inflate", "parse", "route", "draw", "swap", "frame", "handoff", "display", "latency"
+};
+
+const StatsCounter stats_stage_counters[STATS_STAGES] = {
+    STAT_CRC_NS, STAT_INFLATE_NS, STAT_PARSE_NS, STAT_ROUTE_NS, STAT_DRAW_NS, STAT_SWAP_NS, STAT_FRAME_NS,
+    STAT_HANDOFF_NS, STAT_DISPLAY_NS, STAT_LATENCY_NS
+};
+
+static StatsBlock stats_blocks[STATS_THREADS_MAX];
+static atomic_size_t stats_block_count;
+
+// give the calling thread a block of its own
+void stats_register(const char *name) {
+    size_t i = atomic_fetch_add(&stats_block_count, 1);
+
+    if (i >= STATS_THREADS_MAX) {
+        fprintf(stderr, "Warning: more than %d threads keep stats, %s shares a block\n", STATS_THREADS_MAX, name);
+        return;
+    }
+
+    stats_blocks[i].name = name;
+    stats_local = &stats_blocks[i];
+}
+
+static void stats_hist_add(_Atomic uint64_t *hist, size_t bucket) {
+    uint64_t v = atomic_load_explicit(&hist[bucket], memory_order_relaxed);
+    atomic_store_explicit(&hist[bucket], v + 1, memory_order_relaxed);
+}
+
+// one run of a stage taking ns; for STAGE_FRAME the work of a pass of the
+// render loop before it sleeps
+void stats_time(StatsStage stage, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+
+    stats_add(stats_stage_counters[stage], ns);
+
+    if (stats_local) {
+        stats_hist_add(stats_local->hist[stage], bucket);
+    } else {
+        atomic_fetch_add_explicit(&stats_shared.hist[stage][bucket], 1, memory_order_relaxed);
+    }
+}
+
+static void stats_sum(StatsTotals *totals, const StatsBlock *b) {
+    for (size_t i = 0; i < STAT_COUNTERS; i++) {
+        totals->counters[i] += atomic_load_explicit(&b->counters[i], memory_order_relaxed);
+    }
+    for (size_t i = 0; i < STATS_STAGES; i++) {
+        for (size_t j = 0; j < STATS_BUCKETS; j++) {
+            totals->hist[i][j] += atomic_load_explicit(&b->hist[i][j], memory_order_relaxed);
+        }
+    }
+}
+
+void stats_collect(StatsTotals *totals) {
+    size_t count = atomic_load(&stats_block_count);
+
+    memset(totals, 0, sizeof(StatsTotals));
+    for (size_t i = 0; i < count && i < STATS_THREADS_MAX; i++) {
+        stats_sum(totals, &stats_blocks[i]);
+    }
+    stats_sum(totals, &stats_shared);
+}
+
+bool stats_report_due(const StatsReport *report, double now) {
+    return now - report->last_time >= STATS_REPORT_SECONDS;
+}
+
+// upper bound in ms of the bucket holding the given fraction of count runs
+static double stats_percentile(const uint64_t *hist, uint64_t count, double fraction) {
+    uint64_t seen = 0;
+
+    if (!count) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen && seen >= count * fraction) {
+            return (1ULL << i) / 1e3;
+        }
+    }
+
+    return (1ULL << (STATS_BUCKETS - 1)) / 1e3;
+}
+
+static double per(uint64_t total, uint64_t count, double unit) {
+    return count ? total / unit / count : 0;
+}
+
+// rebuild the text from what changed since the last report; slowest is the
+// widget that took longest to draw over that time
+void stats_report_update(StatsReport *report, double now, const char *slowest, uint64_t slowest_ns) {
+    StatsTotals totals, delta;
+    double elapsed = now - report->last_time;
+
+    stats_collect(&totals);
+    for (size_t i = 0; i < STAT_COUNTERS; i++) {
+        delta.counters[i] = totals.counters[i] - report->last.counters[i];
+    }
+    for (size_t i = 0; i < STATS_STAGES; i++) {
+        for (size_t j = 0; j < STATS_BUCKETS; j++) {
+            delta.hist[i][j] = totals.hist[i][j] - report->last.hist[i][j];
+        }
+    }
+
+    if (!report->last_time || elapsed <= 0) {
+        elapsed = STATS_REPORT_SECONDS;
+    }
+
+    const uint64_t *c = delta.counters;
+    uint64_t frames = c[STAT_FRAMES];
+    uint64_t redraws = c[STAT_REDRAWS];
+    uint64_t shown = 0;
+
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        shown += delta.hist[STAGE_LATENCY][i];
+    }
+
+    snprintf(report->text, sizeof(report->text),
+             "FPS: %.2f UP: %.0f MB/s\n"
+             "frame %.2f ms p50 %.1f p99 %.1f ms\n"
+             "latency p50 %.1f p99 %.1f ms\n"
+             "draw %.2f swap %.2f ms %" PRIu64 " redraws\n"
+             "pkts %" PRIu64 "/s drop %" PRIu64 " crc %" PRIu64 "\n"
+             "lost %" PRIu64 " dup %" PRIu64 " late %" PRIu64 "\n"
+             "inflate %.0f parse %.0f route %.0f us\n"
+             "copied %.0f B/pkt\n"
+             "slowest %s %.0f us",
+             frames / elapsed, per(c[STAT_UPLOAD_BYTES] * 1000, c[STAT_UPLOAD_NS], 1),
+             per(c[STAT_FRAME_NS], frames, 1e6),
+             stats_percentile(delta.hist[STAGE_FRAME], frames, 0.5), stats_percentile(delta.hist[STAGE_FRAME], frames, 0.99),
+             stats_percentile(delta.hist[STAGE_LATENCY], shown, 0.5), stats_percentile(delta.hist[STAGE_LATENCY], shown, 0.99),
+             per(c[STAT_DRAW_NS], redraws, 1e6), per(c[STAT_SWAP_NS], redraws, 1e6), redraws,
+             (uint64_t)(c[STAT_PACKETS] / elapsed), totals.counters[STAT_DROPPED], totals.counters[STAT_CRC_ERRORS],
+             totals.counters[STAT_LOST], totals.counters[STAT_DUPLICATES], totals.counters[STAT_REORDERED],
+             per(c[STAT_INFLATE_NS], c[STAT_PACKETS], 1e3), per(c[STAT_PARSE_NS], c[STAT_PARSED], 1e3),
+             per(c[STAT_ROUTE_NS], c[STAT_PARSED], 1e3), per(c[STAT_COPY_BYTES], c[STAT_PARSED], 1),
+             slowest ? slowest : "-", slowest_ns / 1e3 / (redraws ? redraws : 1));
+
+    report->last = totals;
+    report->last_time = now;
+}
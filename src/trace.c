@@ -0,0 +1,118 @@
+#include "trace.h"
+
+// start tracing packets into filename for the given number of seconds
+TraceLog *trace_open(const char *filename, double seconds) {
+    TraceLog *log = calloc(1, sizeof(TraceLog));
+    if (log == NULL) {
+        perror("Error: Memory allocation failed");
+        return NULL;
+    }
+
+    log->filename = strdup(filename);
+    log->capacity = TRACE_PACKETS_MAX;
+    log->packets = malloc(sizeof(PacketTrace) * log->capacity);
+    if (log->filename == NULL || log->packets == NULL) {
+        perror("Error: Memory allocation failed");
+        trace_close(log);
+        return NULL;
+    }
+
+    log->until = stats_ns() + seconds * 1e9;
+    printf("Tracing packets to %s for %.0f s\n", filename, seconds);
+    return log;
+}
+
+static void trace_event(FILE *f, bool *first, const char *name, int tid, uint64_t seq, uint64_t from, uint64_t to, uint64_t base) {
+    if (!from || !to || to < from) {
+        return;
+    }
+
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"packet\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%" PRIu64 "}}",
+            *first ? "" : ",", name, tid, (from - base) / 1e3, (to - from) / 1e3, seq);
+    *first = false;
+}
+
+// the listener and render loop steps as complete events on their own tracks,
+// and each packet's whole life as an async span
+static int trace_write(TraceLog *log) {
+    FILE *f = fopen(log->filename, "w");
+    bool first = true;
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not write trace %s\n", log->filename);
+        return -1;
+    }
+
+    uint64_t base = log->count ? log->packets[0].received : 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    fprintf(f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"listener\"}},");
+    fprintf(f, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"render\"}}");
+    first = false;
+
+    for (size_t i = 0; i < log->count; i++) {
+        const PacketTrace *t = &log->packets[i];
+
+        trace_event(f, &first, "crc", 1, t->seq, t->received, t->checked, base);
+        trace_event(f, &first, "inflate", 1, t->seq, t->checked, t->inflated, base);
+        trace_event(f, &first, "handoff", 1, t->seq, t->inflated, t->handed_off, base);
+        trace_event(f, &first, "parse", 2, t->seq, t->picked_up, t->parsed, base);
+        trace_event(f, &first, "route", 2, t->seq, t->parsed, t->routed, base);
+        trace_event(f, &first, "display", 2, t->seq, t->routed, t->shown, base);
+
+        uint64_t end = t->shown ? t->shown : t->routed;
+        fprintf(f, ",\n{\"name\":\"packet\",\"cat\":\"latency\",\"ph\":\"b\",\"id\":%" PRIu64 ",\"pid\":1,\"tid\":1,\"ts\":%.3f}", t->seq, (t->received - base) / 1e3);
+        fprintf(f, ",\n{\"name\":\"packet\",\"cat\":\"latency\",\"ph\":\"e\",\"id\":%" PRIu64 ",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"shown\":%s}}",
+                t->seq, (end - base) / 1e3, t->shown ? "true" : "false");
+    }
+
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error: Could not write trace %s\n", log->filename);
+        return -1;
+    }
+
+    printf("Wrote %zu packets to trace %s\n", log->count, log->filename);
+    return 0;
+}
+
+// render loop, once a packet is routed: add its latencies to the stage
+// histograms, and to the trace while the window is open. The trace is
+// written, and the log closed, by the first packet after the window.
+void trace_packet(TraceLog *log, const PacketTrace *t) {
+    if (t->handed_off && t->picked_up) {
+        stats_time(STAGE_HANDOFF, t->picked_up - t->handed_off);
+    }
+    if (t->shown) {
+        stats_time(STAGE_DISPLAY, t->shown - t->routed);
+        stats_time(STAGE_LATENCY, t->shown - t->received);
+    }
+
+    if (log == NULL || !log->packets) {
+        return;
+    }
+
+    if (log->count < log->capacity && t->received < log->until) {
+        log->packets[log->count++] = *t;
+        return;
+    }
+
+    trace_write(log);
+    free(log->packets);
+    log->packets = NULL;
+}
+
+void trace_close(TraceLog *log) {
+    if (log == NULL) {
+        return;
+    }
+
+    if (log->packets && log->count) {
+        trace_write(log);
+    }
+
+    free(log->packets);
+    free(log->filename);
+    free(log);
+}
@@ -0,0 +1,278 @@
+#include "uring.h"
+
+// no liburing, the three system calls are all it needs
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t size) {
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, size);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// hand buffer bid back to the kernel, seen once the tail is published
+static void uring_buffer_add(Uring *u, uint16_t bid) {
+    struct io_uring_buf *b = &u->buf_ring->bufs[u->buf_tail & (URING_BUFFERS - 1)];
+
+    b->addr = (uintptr_t)(u->buffers + (size_t)bid * URING_BUFFER_SIZE);
+    b->len = URING_BUFFER_SIZE;
+    b->bid = bid;
+    u->buf_tail++;
+}
+
+static void uring_buffers_publish(Uring *u) {
+    atomic_store_explicit((_Atomic uint16_t *)&u->buf_ring->tail, u->buf_tail, memory_order_release);
+}
+
+// the ring, its buffers and their registration; -1 with errno set if the
+// kernel lacks any of it
+static int uring_open(Uring *u) {
+    struct io_uring_params p = {.flags = IORING_SETUP_CQSIZE, .cq_entries = URING_CQ_ENTRIES};
+
+    u->fd = uring_setup(URING_ENTRIES, &p);
+    if (u->fd < 0) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->ring == MAP_FAILED || u->sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    u->sq_tail = (_Atomic uint32_t *)(u->ring + p.sq_off.tail);
+    u->sq_mask = *(uint32_t *)(u->ring + p.sq_off.ring_mask);
+    u->sq_array = (uint32_t *)(u->ring + p.sq_off.array);
+    u->cq_head = (_Atomic uint32_t *)(u->ring + p.cq_off.head);
+    u->cq_tail = (_Atomic uint32_t *)(u->ring + p.cq_off.tail);
+    u->cq_mask = *(uint32_t *)(u->ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(u->ring + p.cq_off.cqes);
+
+    // page aligned, as the registration wants
+    u->buf_ring_size = URING_BUFFERS * sizeof(struct io_uring_buf);
+    u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->buffers = aligned_alloc(64, URING_BUFFERS * URING_BUFFER_SIZE);
+    if (u->buf_ring == MAP_FAILED || u->buffers == NULL) {
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uintptr_t)u->buf_ring,
+        .ring_entries = URING_BUFFERS,
+        .bgid = URING_GROUP
+    };
+    if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < URING_BUFFERS; i++) {
+        uring_buffer_add(u, i);
+    }
+    uring_buffers_publish(u);
+
+    u->msg.msg_namelen = sizeof(struct sockaddr_in);
+    return 0;
+}
+
+// the next free sqe, cleared; uring_submit() hands it to the kernel
+static struct io_uring_sqe *uring_sqe(Uring *u) {
+    uint32_t tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+    uint32_t index = tail & u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    u->sq_array[index] = index;
+    return sqe;
+}
+
+static int uring_submit(Uring *u) {
+    uint32_t tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+
+    atomic_store_explicit(u->sq_tail, tail + 1, memory_order_release);
+    return uring_enter(u->fd, 1, 0, 0, NULL, 0) == 1 ? 0 : -1;
+}
+
+// queue the multishot recvmsg, again whenever the kernel ends it
+static int uring_arm(Uring *u) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = u->sockfd;
+    sqe->addr = (uintptr_t)&u->msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_GROUP;
+    sqe->user_data = URING_RECV;
+
+    if (uring_submit(u) != 0) {
+        return -1;
+    }
+    u->armed = true;
+    return 0;
+}
+
+// end the receive and wait for its last completion, so the kernel is done
+// with the buffers before they are freed; whatever it still delivers is
+// dropped, the listener is stopping or moving over to recvfrom
+static void uring_cancel(Uring *u) {
+    struct __kernel_timespec timeout = {.tv_sec = 0, .tv_nsec = 100000000};
+    struct io_uring_getevents_arg arg = {.ts = (uintptr_t)&timeout};
+
+    if (!u->armed) {
+        return;
+    }
+
+    struct io_uring_sqe *sqe = uring_sqe(u);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = URING_RECV;
+    sqe->user_data = URING_CANCEL;
+    if (uring_submit(u) != 0) {
+        return;
+    }
+
+    for (int tries = 0; u->armed && tries < 10; tries++) {
+        if (uring_enter(u->fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+            errno != ETIME && errno != EINTR) {
+            return;
+        }
+
+        uint32_t head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+
+            if (cqe->user_data != URING_RECV) {
+                continue;
+            }
+            if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                stats_add(STAT_DROPPED, 1);
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                u->armed = false;
+            }
+        }
+
+        atomic_store_explicit(u->cq_head, head, memory_order_release);
+    }
+}
+
+static void uring_close(Uring *u) {
+    // closing the ring would cancel the receive too, but without waiting
+    if (u->fd >= 0) {
+        uring_cancel(u);
+        close(u->fd);
+    }
+    if (u->ring && u->ring != MAP_FAILED) {
+        munmap(u->ring, u->ring_size);
+    }
+    if (u->sqes && u->sqes != MAP_FAILED) {
+        munmap(u->sqes, u->sqes_size);
+    }
+    if (u->buf_ring && u->buf_ring != MAP_FAILED) {
+        munmap(u->buf_ring, u->buf_ring_size);
+    }
+    free(u->buffers);
+}
+
+// listener: receive on sockfd through io_uring until shutdown, 0 once done;
+// -1 if the kernel cannot do it and the caller should fall back to recvfrom
+int uring_receive(int sockfd, Ingest *in) {
+    Uring u = {.fd = -1, .sockfd = sockfd};
+    struct __kernel_timespec timeout = {.tv_sec = 1, .tv_nsec = 0};
+    struct io_uring_getevents_arg arg = {.ts = (uintptr_t)&timeout};
+    size_t received = 0;
+    int ret = 0;
+
+    if (uring_open(&u) != 0 || uring_arm(&u) != 0) {
+        fprintf(stderr, "io_uring receive unavailable (%s), using recvfrom\n", strerror(errno));
+        uring_close(&u);
+        return -1;
+    }
+
+    // block for completions, waking up now and then to notice a shutdown
+    while (running) {
+        if (uring_enter(u.fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+            errno != ETIME && errno != EINTR) {
+            perror("io_uring_enter failed, using recvfrom");
+            ret = -1;
+            break;
+        }
+
+        uint32_t head = atomic_load_explicit(u.cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(u.cq_tail, memory_order_acquire);
+        bool rearm = false;
+
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &u.cqes[head & u.cq_mask];
+
+            // out of buffers or failed, the receive has to be queued again
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                u.armed = false;
+                rearm = true;
+            }
+
+            if (cqe->res < 0) {
+                // multishot recvmsg is newer than the buffer ring
+                if (cqe->res == -EINVAL && !received) {
+                    fprintf(stderr, "io_uring multishot recvmsg unsupported, using recvfrom\n");
+                    ret = -1;
+                } else if (cqe->res != -ENOBUFS) {
+                    fprintf(stderr, "io_uring recvmsg failed: %s\n", strerror(-cqe->res));
+                }
+                continue;
+            }
+
+            if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+                continue;
+            }
+
+            uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t *buffer = u.buffers + (size_t)bid * URING_BUFFER_SIZE;
+            const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+            const uint8_t *packet = buffer + sizeof(struct io_uring_recvmsg_out) + u.msg.msg_namelen + u.msg.msg_controllen;
+            struct sockaddr_in from;
+
+            // the address is always there, cut to the length asked for
+            memcpy(&from, buffer + sizeof(struct io_uring_recvmsg_out), sizeof(from));
+
+            if (out->flags & MSG_TRUNC) {
+                fprintf(stderr, "Oversized datagram (%u bytes), dropping\n", out->payloadlen);
+                stats_add(STAT_DROPPED, 1);
+            } else {
+                ingest_packet(in, packet, out->payloadlen, &from);
+            }
+            received++;
+
+            uring_buffer_add(&u, bid);
+        }
+
+        atomic_store_explicit(u.cq_head, head, memory_order_release);
+        uring_buffers_publish(&u);
+
+        if (ret != 0) {
+            break;
+        }
+        if (rearm && running && uring_arm(&u) != 0) {
+            perror("io_uring submit failed, using recvfrom");
+            ret = -1;
+            break;
+        }
+    }
+
+    uring_close(&u);
+    return ret;
+}
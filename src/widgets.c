@@ -1,133 +1,267 @@
 #include "widgets.h"
 
-void widget_free(Widget *w) {
-    if (w->identifier) {
-        free(w->identifier);
+WidgetType widget_type(const char *type) {
+    if (!type) {
+        return WIDGET_UNKNOWN;
+    } else if (strcmp(type, "graph") == 0) {
+        return WIDGET_GRAPH;
+    } else if (strcmp(type, "value") == 0) {
+        return WIDGET_VALUE;
+    } else if (strcmp(type, "text") == 0) {
+        return WIDGET_TEXT;
+    } else if (strcmp(type, "png") == 0) {
+        return WIDGET_PNG;
+    } else if (strcmp(type, "stats") == 0) {
+        return WIDGET_STATS;
     }
-    if (w->type) {
-        free(w->type);
+    return WIDGET_UNKNOWN;
+}
+
+// one sample every scale pixels, or with a window enough raw samples for
+// short windows plus the rollups for long ones
+int widget_history_init(Widget *w, Arena *arena) {
+    size_t capacity = w->width > 2 ? w->width / w->scale + 1 : 0;
+
+    if (w->kind != WIDGET_GRAPH) {
+        return 0;
     }
-    if (w->filename) {
-        free(w->filename);
+
+    if (w->window > 0 && capacity) {
+        capacity = w->width > HISTORY_RAW_MIN ? w->width : HISTORY_RAW_MIN;
     }
-    if (w->text) {
-        free(w->text);
+
+    return history_init(&w->history, arena, capacity, w->window);
+}
+
+void widget_log_push(Widget *w, double value, double time) {
+    history_push(&w->history, value, time);
+}
+
+// take over the history of the same widget in the previous config, trimmed
+// to what the (possibly resized) graph keeps
+void widget_adopt_history(Widget *w, Widget *old) {
+    history_adopt(&w->history, &old->history);
+}
+
+// borders, pngs and text labels never change after load, they are composited
+// once into the background layer instead of being redrawn every frame
+void widget_draw_static(Widget *w, FrameBuffer *fb) {
+    if (w->has_border) {
+        fb_hspan(fb, w->left, w->top, w->width, w->border_color); // top
+        fb_vspan(fb, w->left, w->top, w->height + 1, w->border_color); // left
+        fb_hspan(fb, w->left, w->top + w->height, w->width, w->border_color); // bottom
+        fb_vspan(fb, w->left + w->width - 1, w->top, w->height + 1, w->border_color); // right
     }
 
-    LogEntry *e = w->head;
-    while(e) {
-        w->head = w->head->next;
-        free(e);
-        e = w->head;
+    if (w->kind == WIDGET_PNG && w->png) {
+        if (!w->png->data || !w->png->width || !w->png->height) {
+            return;
+        }
+
+        fb_blit(fb, w->png->data, w->png->alpha, w->png->width, w->png->height, w->left, w->top);
+    } else if (w->kind == WIDGET_TEXT && w->font) {
+        if (w->text) {
+            ft_draw_string(w->font, fb, w->text, w->left, w->top, w->line_color);
+        }
     }
 }
 
-void widget_log_push(Widget *w, double value) {
-    if (w->width <= 2) {
-        return;
+static size_t graph_y(const Widget *w, double value) {
+    double scaled = value;
+
+    if ((w->min != 0 || w->max != 0) && w->max > w->min) {
+        scaled = (value - w->min) * (w->height - 2) / (w->max - w->min);
     }
 
-    LogEntry *e = calloc(1, sizeof(LogEntry));
-    if (e == NULL) {
-        perror("Memory allocation error.");
-        return;
+    if (scaled < 0) scaled = 0;
+    if (scaled > w->height - 2) scaled = w->height - 2;
+
+    return w->top + w->height - 1 - (size_t)scaled;
+}
+
+// 0 for never, samples being drawn however far apart they arrive
+static double graph_gap(const Widget *w) {
+    if (w->gap > 0) {
+        return w->gap;
     }
+    return w->window > 0 ? GRAPH_GAP_DEFAULT : 0;
+}
 
-    e->value = value;
+// one sample every scale pixels, newest on the right, with the line broken
+// where samples are further apart than the gap, if it has one
+static void graph_draw_samples(Widget *w, FrameBuffer *fb, uint32_t line_color, uint32_t shade_color) {
+    const HistoryLevel *l = &w->history.levels[0];
+    size_t bottom = w->top + w->height - 1;
+    size_t prev_x = 0, prev_y = 0;
+    double prev_time = 0, gap = graph_gap(w);
 
-    if (w->head == NULL) {
-        w->head = w->tail = e;
-        w->log_count = 1;
-    } else {
-        w->head->prev = e;
-        e->next = w->head;
-        w->head = e;
+    for (size_t i = 0; i < l->count; i++) {
+        const Sample *s = history_at(l, i);
+        size_t x = w->left + 1;
 
-        if (w->log_count >= w->width / w->scale + 1) {
-            LogEntry *old_tail = w->tail;
-            w->tail = w->tail->prev;
-            w->tail->next = NULL;
-            free(old_tail);
-        } else {
-            w->log_count++;
+        if (i * w->scale < w->left + w->width - 1 && w->left + w->width - 1 - i * w->scale > w->left + 1) {
+            x = w->left + w->width - 1 - i * w->scale;
         }
+        size_t y = graph_y(w, s->sum / s->count);
+
+        if (i && (!gap || prev_time - s->time <= gap)) {
+            fb_draw_line_shaded(fb, prev_x, prev_y, x, y, bottom, line_color, shade_color);
+        }
+
+        prev_x = x;
+        prev_y = y;
+        prev_time = s->time;
     }
 }
 
-void widget_draw(Widget *w, FrameBuffer *fb) {
-    char buf[20];
+static void graph_draw_column(Widget *w, FrameBuffer *fb, size_t x, const Sample *c, size_t *prev_x, size_t *prev_y, uint32_t line_color, uint32_t shade_color) {
+    size_t bottom = w->top + w->height - 1;
+    size_t y_max = graph_y(w, c->max);
+    size_t y_min = graph_y(w, c->min);
+    size_t y_avg = graph_y(w, c->sum / c->count);
 
-    if (w->has_border) {
-        fb_draw_line(fb, w->left, w->top, w->left + w->width - 1, w->top, w->border_color); // top
-        fb_draw_line(fb, w->left, w->top, w->left, w->top + w->height, w->border_color); // left
-        fb_draw_line(fb, w->left, w->top + w->height, w->left + w->width - 1, w->top + w->height, w->border_color); // bottom
-        fb_draw_line(fb, w->left + w->width - 1, w->top, w->left + w->width - 1, w->top + w->height,  w->border_color); // right
+    // bridge columns without samples, and join the envelope to the previous
+    // column so it stays connected
+    if (*prev_x) {
+        if (*prev_x > x + 1) {
+            fb_draw_line_shaded(fb, x, y_avg, *prev_x, *prev_y, bottom, line_color, shade_color);
+        }
+        y_max = *prev_y < y_max ? *prev_y : y_max;
+        y_min = *prev_y > y_min ? *prev_y : y_min;
     }
 
-    if (strcmp(w->type, "graph") == 0) {
-        LogEntry *e = w->head;
-        if (!e) {
-            return;
+    if (y_min < bottom) {
+        fb_vspan(fb, x, y_min + 1, bottom - y_min, shade_color);
+    }
+    fb_vspan(fb, x, y_max, y_min - y_max + 1, line_color);
+    *prev_x = x;
+    *prev_y = y_avg;
+}
+
+// the right edge of a window graph advances a whole column at a time, so a
+// sample keeps its column and the graph only changes when it scrolls by one
+static double graph_right(const Widget *w, double now) {
+    double per_column = w->window / (w->width - 2);
+    return ceil(now / per_column) * per_column;
+}
+
+// min/max envelope of the window ending now, one column per pixel, from the
+// finest history level that still covers it. Only the entries inside the
+// window are visited, and the envelope is broken where samples are further
+// apart than the gap.
+static void graph_draw_window(Widget *w, double now, FrameBuffer *fb, uint32_t line_color, uint32_t shade_color) {
+    size_t columns = w->width - 2;
+    double per_column = w->window / columns;
+    double right = graph_right(w, now);
+    double left = right - columns * per_column;
+    const HistoryLevel *l = history_level_for(&w->history, left);
+    Sample column = {0};
+    size_t current = 0, prev_x = 0, prev_y = 0;
+    double newer = 0;
+
+    if (!l || !l->count) {
+        return;
+    }
+
+    double gap = graph_gap(w) + l->span;
+    size_t visible = history_count_since(l, left);
+
+    for (size_t i = 0; i < visible; i++) {
+        const Sample *s = history_at(l, i);
+        double age = right - (s->time + l->span);
+        size_t c = age > 0 ? age / per_column : 0;
+        bool broken = i && newer - s->time > gap;
+
+        if (c >= columns) {
+            break;
         }
-        size_t i = 0;
-        size_t bottom = w->top + w->height - 1;
-        size_t prev_x = w->left + 1, prev_y = bottom;
-        size_t x = 0, y = 0;
-        bool first_point = true;
-
-        while(e) {
-            size_t scaled_value = e->value;
-
-            if ((w->min != 0 || w->max != 0) && w->max > w->min) {
-                scaled_value = (e->value - w->min) * (w->height - 2) / (w->max - w->min);
-            }
-
-            if (scaled_value > w->height - 2) scaled_value = w->height - 2;
-
-            if (i * w->scale < w->left + w->width - 1 && w->left + w->width - 1 - i * w->scale > w->left + 1) {
-                x = w->left + w->width - 1 - i * w->scale;
-            } else {
-                x = w->left + 1;
-            }
-            y = bottom - scaled_value;
-
-            if (first_point) {
-                prev_x = x;
-                prev_y = y;
-                first_point = false;
-                continue;
-            }
-
-            fb_draw_line_shaded(fb, prev_x, prev_y, x, y, w->top + w->height - 1, w->line_color, rgb_to_rgb565(0x33, 0x33, 0x33));
-
-            prev_x = x;
-            prev_y = y;
-
-            e = e->next;
-            i++;
+
+        if (column.count && (c != current || broken)) {
+            graph_draw_column(w, fb, w->left + w->width - 2 - current, &column, &prev_x, &prev_y, line_color, shade_color);
+            column.count = 0;
         }
-    } else if (strcmp(w->type, "png") == 0 && w->png) {
-        if (!w->png->data || !w->png->width || !w->png->height) {
+
+        if (broken) {
+            prev_x = 0;
+        }
+
+        if (!column.count) {
+            column = *s;
+            current = c;
+        } else {
+            column.min = s->min < column.min ? s->min : column.min;
+            column.max = s->max > column.max ? s->max : column.max;
+            column.sum += s->sum;
+            column.count += s->count;
+        }
+        newer = s->time;
+    }
+
+    if (column.count) {
+        graph_draw_column(w, fb, w->left + w->width - 2 - current, &column, &prev_x, &prev_y, line_color, shade_color);
+    }
+}
+
+// whether a window graph drawn at one time would look different at another
+bool widget_scrolled(const Widget *w, double from, double to) {
+    if (w->kind != WIDGET_GRAPH || w->window <= 0 || w->width <= 2) {
+        return false;
+    }
+
+    return graph_right(w, from) != graph_right(w, to);
+}
+
+// a stale widget is drawn in grey so frozen data does not pass for live data
+void widget_draw(Widget *w, double value, double now, bool stale, FrameBuffer *fb) {
+    uint32_t line_color = stale ? fb_rgb(fb, 0x66, 0x66, 0x66) : w->line_color;
+    char buf[20];
+
+    if (w->kind == WIDGET_GRAPH) {
+        if (w->width <= 2 || w->height <= 2) {
             return;
         }
 
-        size_t i = 0;
-        for (size_t y = 0; y < w->png->height; y++) {
-            for (size_t x = 0; x < w->png->width; x++) {
-                if (x < fb->w && y < fb->h) {
-                    fb_set_pixel(fb, x + w->left, y + w->top, w->png->data[i]);
-                    i++;
-                }
-            }
+        if (w->window > 0) {
+            graph_draw_window(w, now, fb, line_color, fb_rgb(fb, 0x33, 0x33, 0x33));
+        } else {
+            graph_draw_samples(w, fb, line_color, fb_rgb(fb, 0x33, 0x33, 0x33));
         }
-    } else if (strcmp(w->type, "value") == 0 && w->face) {
+    } else if (w->kind == WIDGET_VALUE && w->font) {
         char format[16];
         snprintf(format, sizeof(format), "%%.%ldf", w->precision);
-        snprintf(buf, sizeof(buf), format, w->value);
-        ft_draw_string(w->face, fb, buf, w->left, w->top, w->line_color);
-    } else if (strcmp(w->type, "text") == 0 && w->face) {
-        if (w->text) {
-            ft_draw_string(w->face, fb, w->text, w->left, w->top, w->line_color);
+        snprintf(buf, sizeof(buf), format, value);
+        ft_draw_string(w->font, fb, buf, w->left, w->top, line_color);
+    }
+}
+
+// one line of text per font line, as many as fit in the widget's height, or
+// all of them if it has none
+void widget_draw_lines(Widget *w, const char *text, FrameBuffer *fb) {
+    char line[128];
+    size_t y = w->top;
+
+    if (!w->font || !text) {
+        return;
+    }
+
+    size_t line_height = ft_line_height(w->font);
+
+    while (*text) {
+        size_t len = strcspn(text, "\n");
+
+        if (w->height && y + line_height > w->top + w->height) {
+            break;
+        }
+
+        if (len >= sizeof(line)) {
+            len = sizeof(line) - 1;
         }
+        memcpy(line, text, len);
+        line[len] = 0;
+        ft_draw_string(w->font, fb, line, w->left, y, w->line_color);
+
+        text += strcspn(text, "\n");
+        text += *text == '\n';
+        y += line_height;
     }
 }